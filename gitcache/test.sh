@@ -0,0 +1,29 @@
+# Run from this directory after ``gcc -o ../mywc ../mywc.c''. Prints the differences, if any.
+mywc=$(pwd)/../mywc
+repo=$(mktemp -d)
+cd "$repo"
+git init -q
+printf 'the\non\n' > stop.txt
+printf 'the cat sat\non the mat\n' > cat.txt
+printf 'int main() { return 0; }\n' > main.c
+git add cat.txt main.c
+git -c user.name=test -c user.email=test commit -q -m test
+expected=$("$mywc" --git-rev=HEAD)
+rm -f .git/mywc-cache
+for mode in "--only-words=stop.txt" "--exclude-words=stop.txt" "--prose" "--code-stats"
+  do
+    "$mywc" $mode --git-rev=HEAD > /dev/null
+    diff <(echo "$expected") <("$mywc" --git-rev=HEAD) || echo "plain counts changed after $mode"
+    diff <("$mywc" $mode --git-rev=HEAD) <("$mywc" $mode --git-rev=HEAD) || echo "$mode changed with a warm cache"
+  done
+for mode in "--graphemes" "--max-width" "--max-width=10" "--per-line" "--per-line=histogram" "--per-line=3"
+  do
+    rm -f .git/mywc-cache
+    "$mywc" --git-rev=HEAD > /dev/null
+    diff <("$mywc" $mode cat.txt main.c) <("$mywc" $mode --git-rev=HEAD) || echo "$mode differs with --git-rev"
+  done
+"$mywc" --boundaries=files.b cat.txt main.c > /dev/null
+"$mywc" --boundaries=blobs.b --git-rev=HEAD > /dev/null
+cmp -s files.b blobs.b || echo "--boundaries differs with --git-rev"
+cd /
+rm -rf "$repo"
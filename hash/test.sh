@@ -0,0 +1,36 @@
+# Run from this directory after ``gcc -o ../mywc ../mywc.c''. Prints the differences, if any.
+# Each line is a length n, then the XXH3 and BLAKE3 of the n bytes 0, 1, ..., 250, 0, 1, ..., the input of
+# the BLAKE3 test vectors.
+mywc=$(pwd)/../mywc
+dir=$(mktemp -d)
+for i in $(seq 0 250); do printf "\\$(printf %03o $i)"; done > "$dir/cycle"
+for i in $(seq 410); do cat "$dir/cycle"; done > "$dir/input"
+while read n xxh3 blake3
+  do
+    head -c $n "$dir/input" > "$dir/$n"
+    [ "$("$mywc" --hash=xxh3 "$dir/$n" | awk '{print $4}')" = $xxh3 ] || echo "xxh3 of $n bytes differs"
+    [ "$("$mywc" --hash=blake3 "$dir/$n" | awk '{print $4}')" = $blake3 ] || echo "blake3 of $n bytes differs"
+  done <<VECTORS
+0 2d06800538d394c2 af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262
+1 c44bdff4074eecdb 2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213
+3 5f4299fc161c9cbb e1be4d7a8ab5560aa4199eea339849ba8e293d55ca0a81006726d184519e647f
+4 60dab036a58211f2 f30f5ab28fe047904037f77b6da4fea1e27241c5d132638d8bedce9d40494f32
+8 3a1c2d7c85af88f8 2351207d04fc16ade43ccab08600939c7c1fa70a5c0aaca76063d04c3228eaeb
+9 e9612598145bb9dc a0fc27e5d7318b723207637bdeeba4f7dcb22f7f9ec3e8b6f3588ddcd4fdf861
+16 8355e3a6f61770db a6a492965517a830cb75fdb713465aa465f2f098233896fea44c1d98268bf9e3
+17 9ef341a99de37328 8462aa7be93b09fda7b93cf9f9cddb703f6dd2cc0c8edd5f9eee092edf8abf0c
+128 85c6174c7ff4c46b f17e570564b26578c33bb7f44643f539624b05df1a76c81f30acd548c44b45ef
+129 ec7642b431ba3e5a 683aaae9f3c5ba37eaaf072aed0f9e30bac0865137bae68b1fde4ca2aebdcb12
+240 375a384d957fe865 45e1a0dc23dbe51733d7269a3c0f519c2a63b0718835b2b537677eba734db0d8
+241 02e8cd95421c6d02 749b36ae651c22e8567db692a6876e0ca4fd3daeb7aa8fa3ab2f642ccc69a8f6
+1023 d3d91d80ac495685 10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11
+1024 e5d78bafa45b2aa5 42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7
+1025 e95c42288f28186e d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444
+2048 25339063db861586 e776b6028c7cd22a4d0ba182a8bf62205d2ef576467e838ed6f2529b85fba24a
+2049 6c9600c0e506e2ae 5f4d72f40d7a5f82b15ca2b2e44b1de3c2ef86c426c95c1af0b6879522563030
+4097 b69d29f17d48293f 9b4052b38f1c5fc8b1f9ff7ac7b27cd242487b3d890d15c96a1c25b8aa0fb995
+8192 40a71c16bbe37322 aae792484c8efe4f19e2ca7d371d8c467ffb10748d8a5a1ae579948f718a2a63
+31744 5162bbaf8b257803 62b6960e1a44bcc1eb1a611a8d6235b6b4b78f32e7abc4fb4c6cdcce94895c47
+102400 1428e17f1cac2837 bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085
+VECTORS
+rm -rf "$dir"
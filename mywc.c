@@ -30,7 +30,10 @@
  *      Furthermore, an additional line containing the total line, word, and character counts of all
  *      files is displayed.
  *
- *      The program works for files encoded in ASCII only.
+ *      The program works for files encoded in ASCII, and for UTF-16 files that start with a byte order
+ *      mark. Those are counted in 16-bit code units: lines end at U+000A, words are separated by U+0009
+ *      to U+000D and U+0020, and the character count is still the number of bytes, mark included. The
+ *      -C option and the line-based options below read UTF-16 files as plain bytes.
  *
  *      The following options are available:
  *
@@ -40,7 +43,159 @@
  *      -C Words and characters in single line, C-language comments that begin with 
  *         ``//'' (two `/' characters) will be excluded from the output. The <newline> character in the 
  *         comment will not be excluded. See the command ``sed 's://.*$::g' |  wc <options>'', which
- *         provides the same functionality.
+ *         provides the same functionality. The comments are found in the whole file, so -C cannot be
+ *         combined with --match, --exclude-words or --only-words, which count only part of it.
+ *      --eol=TERMINATOR
+ *         Selects which line terminators end a line, for the line count and for the line-based
+ *         options below: lf ends a line at every <newline> like the default, crlf only at a
+ *         <carriage-return> <newline> pair, cr at every <carriage-return>, and any at each of a lone
+ *         <newline>, a pair and a lone <carriage-return>. After the counts of each input file, the
+ *         number of each kind of terminator is written to standard output, so files with mixed line
+ *         endings can be found.
+ *      --git-rev=REV
+ *         The file operands are git repositories, the current directory if there are none, and the
+ *         files of revision REV of each are counted instead, as they are stored in the repository,
+ *         with no checkout. REV is a full commit, tree or tag id, or a branch, tag, or other ref name.
+ *         Each file is written with its path in the revision. The counts of every file content are
+ *         kept in the file mywc-cache of the git directory, so counting another revision only reads
+ *         the files that changed. Only plain counts are cached, not those of -C or the options below.
+ *      --snapshot=FILE
+ *         The path, identity (device, inode, modification time and size) and counts of every file
+ *         operand are saved to FILE once all files are counted.
+ *      --diff-against=SNAPSHOT
+ *         Instead of the counts of each file, only the change of the counts since SNAPSHOT, a file
+ *         saved by --snapshot, is written to standard output. Files not in SNAPSHOT are marked A, files
+ *         with changed counts M, and files of SNAPSHOT that are not operands anymore D, followed by a
+ *         line with the total change. A file whose identity has not changed since SNAPSHOT is not read
+ *         again. Combined with --snapshot, a daily report can save the snapshot for the next day in the
+ *         same run. The counts options and -C should be the same as when SNAPSHOT was saved.
+ *      --watch-tree=DIR
+ *         Every file below the directory DIR is counted, then mywc keeps running and watches the
+ *         tree for changes with inotify(7). The totals of each directory, over all files below it,
+ *         are written first for all directories, and after that again for every directory whose
+ *         totals change, as files are created, modified, moved or deleted. Only those files are
+ *         counted again. Directory names are written with a trailing `/'. Symbolic links are not
+ *         followed. The program runs until it is interrupted.
+ *      --engine=ENGINE
+ *         Selects how files are read: stdio, the default, reads each file with the standard I/O
+ *         library, and uring submits the open, stat, read and close of up to 64 files at once to
+ *         io_uring(7), which is much faster for many small files. With uring, all options apply to all
+ *         file operands, wherever they are given. Files larger than 64 kilobytes, and all files on
+ *         systems without io_uring, are read with stdio. The uring engine cannot be combined with
+ *         --snapshot or --diff-against, and mywc exits with an error when it is.
+ *      --hash=xxh3|blake3
+ *         Writes a hash of each file's content after its counts, computed from the same reads: the
+ *         64-bit XXH3, as written by xxhsum -H3, or the 256-bit BLAKE3, as written by b3sum. Blobs of
+ *         --git-rev are hashed too; snapshots and --watch-tree have no hashes.
+ *      --boundaries=FILE
+ *         Writes the word and line boundaries of every file to FILE, in the order of the files, for a
+ *         tokenizer to reuse. Each boundary is the number offset * 4 + kind, where the kind is 0 for
+ *         the start of a word, 1 for the offset just after a word, 2 for a newline, and 3, with the
+ *         length as offset, for the end of a file. Files read by --engine=uring or a snapshot have no
+ *         boundaries.
+ *      --boundary-format=varint|fixed
+ *         How --boundaries writes the numbers: as LEB128 varints with each offset replaced by its
+ *         distance to the previous boundary of the file, the default, or as 8-byte little-endian
+ *         numbers.
+ *      --per-line[=counts|histogram|N]
+ *         Writes the number of words on each line before the counts of a file, like awk '{print NF}'.
+ *         With histogram, writes instead after the counts how many lines have each number of words.
+ *         With a number N, writes only the lines that do not have N words, as the line number and
+ *         its number of words separated by a colon. Lines are counted before --match filters them,
+ *         and not for files read by --engine=uring or a snapshot.
+ *      --prose
+ *         Writes after the counts the number of sentences and paragraphs, and the average number of
+ *         words in a sentence. A sentence ends with a word ending in ``.'', ``!'' or ``?'', possibly
+ *         followed by closing quotes or brackets, that is not a common abbreviation such as ``Dr.''
+ *         or ``e.g.'' or an initial; and also at the end of a paragraph. Paragraphs are separated by
+ *         lines that are blank or only white space.
+ *      --tokens=VOCAB
+ *         Writes after the counts an estimate of the number of tokens a language model would see,
+ *         from the byte-pair vocabulary VOCAB in the tiktoken format, like cl100k_base.tiktoken. Each
+ *         word is encoded as if preceded by a space, and each <newline> is one token, so the estimate
+ *         is close to, but not always, what the model's own tokenizer gives.
+ *      --code-stats
+ *         Writes after the counts the number of C and C++ keywords, identifiers, literals, operators,
+ *         comments and preprocessor directives, from the same pass as the counts. Comments are counted
+ *         whether or not -C excludes them. asm and the alternative tokens such as and and not_eq count
+ *         as keywords, as in C++.
+ *      --trace=FILE
+ *         Records what mywc spends its time on, as spans of opening, reading, counting and printing
+ *         each file, io_uring batches and git objects, and writes them to FILE at exit in the Chrome
+ *         trace-event format, which Perfetto and chrome://tracing open. Only the last 32768 spans are
+ *         kept.
+ *      --exclude-words=FILE
+ *         Counts only the words that are not in FILE, a list of words separated by white space, such
+ *         as a list of stopwords. Words are compared without regard to ASCII case.
+ *      --only-words=FILE
+ *         Counts only the words that are in FILE, such as a vocabulary.
+ *      --at-least=N, --at-most=N
+ *         Writes nothing, and exits with status 0 when the total count is at least N, or at most N,
+ *         or both, with status 1 when it is not, and with status 2 on an error. The count is of lines,
+ *         or of words or characters when -w or -c is the only one given, and the options apply to all
+ *         file operands, wherever they are given. Reading stops as soon as the answer is known, so
+ *         asking whether a large file has more than a few lines returns at once. The other options
+ *         that start with ``--'' are ignored.
+ *      --graphemes
+ *         Writes after the counts the number of grapheme clusters of UTF-8 text, the characters a
+ *         reader sees, as segmented by Unicode Standard Annex #29: an emoji with its modifiers and
+ *         joiners, a flag, a letter with its combining marks or a CR LF pair is one. Bytes that are
+ *         not valid UTF-8 count as the replacement character U+FFFD would. Not for files read by
+ *         --engine=uring or a snapshot.
+ *      --max-width[=N]
+ *         Writes after the counts the display width of the widest line, in terminal columns: wide
+ *         East Asian characters and most emoji take two columns, combining marks and control
+ *         characters none, and a <tab> moves to the next multiple of 8. With a number N, also writes
+ *         the lines wider than N columns before the counts, as the line number and its width
+ *         separated by a colon. Like --graphemes, not for files read by --engine=uring or a snapshot.
+ *      --tune=auto
+ *         Picks the input buffer size and the engine that are fastest for the device of the first file
+ *         operand, by reading the start of the first file and the first files with each. The choice
+ *         is remembered in ~/.cache/mywc-tune for the device and the number of usable CPUs, which
+ *         takes the cgroup CPU quota into account. An explicit --engine=uring is kept. With --snapshot
+ *         or --diff-against, only the buffer size is tuned, and the files are read with stdio.
+ *      --io-limit=RATE
+ *         Input files are read at no more than RATE megabytes (10^6 bytes) per second, on average over
+ *         a tenth of a second, so that a scan of shared storage leaves bandwidth for other programs.
+ *         Each read waits until it is allowed before it is issued. Git objects are not limited.
+ *      --ionice=CLASS[:LEVEL]
+ *         Sets the I/O scheduling class of mywc, like ionice(1): realtime, best-effort or idle, or 1
+ *         to 3, with a LEVEL from 0, the highest priority, to 7, 4 by default. The idle class has no
+ *         levels, and the realtime class usually needs privileges.
+ *      --top-lines=K
+ *         After the counts of each input file, the K most repeated lines and their number of
+ *         occurrences are written to standard output, most frequent first. Lines are tracked by hash
+ *         in a Count-Min sketch and a Space-Saving table of K entries, so memory use stays fixed no
+ *         matter how large the input is. A reported count may overestimate, but never underestimate,
+ *         the real one. Only the first 80 characters of each line are displayed. With multiple input
+ *         files, the tables of all files are merged and reported after the total line.
+ *      --match=REGEX
+ *         Only lines matching the extended regular expression REGEX contribute to the counts, like
+ *         ``grep -E REGEX | wc'' in a single pass. A line matches if REGEX matches any part of it. The
+ *         supported syntax is literal characters, ``.'', bracket expressions with ranges and ``^''
+ *         negation, the escapes \d \w \s \D \W \S \n \t, the ``*'', ``+'' and ``?'' operators,
+ *         ``|'' and parentheses. ``^'' and ``$'' match at the start and the end of the line wherever
+ *         they are, so each alternative of ``^a|b$'' has its own anchor, as with grep -E. A last line
+ *         without a <newline> is included in the word and character counts when it matches.
+ *      --bucket-by=FORMAT
+ *         After the counts of each input file, the lines and bytes of the file are written per time
+ *         bucket, oldest first. The time of a line is read from the timestamp it starts with, which may
+ *         be enclosed in ``['', in one of these FORMATs:
+ *            iso8601  2024-05-01T13:45:12, optionally with a fraction and a Z or +hh:mm offset. A space
+ *                     may replace the T. Offsets are applied, so buckets are in UTC.
+ *            epoch    seconds since 1970, or milli-, micro- or nanoseconds with 13, 16 or 19 digits.
+ *            syslog   May  1 13:45:12. The year is taken to be the current one.
+ *         Lines that do not start with a timestamp, or with one of a date that does not exist such as
+ *         2023-02-29, are reported last, in a bucket shown as ``-''.
+ *         Combined with --match, only matching lines are bucketed.
+ *      --bucket-width=SECONDS
+ *         The width of the --bucket-by time buckets, 60 by default.
+ *      --jsonl[=keys]
+ *         Each input file is read as JSON Lines. After its counts, the number of records (lines
+ *         holding one valid JSON value) and of malformed lines is written to standard output. Blank
+ *         lines are neither. With --jsonl=keys, the number of records using each key of a top-level
+ *         object follows, most used first. Escaped newlines inside strings do not split records.
+ *         Combined with --match, only matching lines are read as records.
  *
  *      By default, the mywc program always outputs the line, word, and character counts in that order.
  *      Just like the wc(1) command, if all three options are specified, the order above will be kept
@@ -56,6 +211,10 @@
  * EXIT STATUS
  *      The mywc program exits 0 on success, and > 0 if an error occurs. 
  *
+ *      With --at-least or --at-most, mywc exits 0 when the total is in range, 1 when it is not, and 2
+ *      if an error occurs, such as a file that cannot be read or a count that is not a number, like
+ *      grep(1) and cmp(1).
+ *
  * EXAMPLES
  *      Count the number of characters, words, and lines of each file and totals for both:
  *              ./mywc file1.txt file2.txt 
@@ -64,6 +223,51 @@
  *      and report totals of both:
  *              ./mywc -C file1.txt file2.txt
  *     
+ *      Show the 10 most repeated lines of a log file:
+ *              ./mywc --top-lines=10 server.log
+ *
+ *      Count the lines, words, and characters of the error lines of a log file:
+ *              ./mywc --match='ERROR|FATAL' server.log
+ *
+ *      Count the lines and bytes per hour of a log file with ISO 8601 timestamps:
+ *              ./mywc --bucket-by=iso8601 --bucket-width=3600 server.log
+ *
+ *      Validate a JSON Lines dump and list the keys of its records:
+ *              ./mywc --jsonl=keys events.jsonl
+ *
+ *      Count the lines of a file with old Mac line endings, and report which endings it uses:
+ *              ./mywc -l --eol=any notes.txt
+ *
+ *      Count the files of the main branch of the repository in the current directory:
+ *              ./mywc --git-rev=main
+ *
+ *      Report the change in counts of the C files since yesterday, and save today's snapshot:
+ *              ./mywc --diff-against=yesterday.snap --snapshot=today.snap *.c
+ *
+ *      Keep the line counts of a source tree up to date:
+ *              ./mywc -l --watch-tree=src
+ *
+ *      Count a large file on shared storage at 50 MB/s or less, in the idle I/O class:
+ *              ./mywc --io-limit=50 --ionice=idle dump.log
+ *
+ *      Count a release tarball and check it against its published BLAKE3 hash in the same read:
+ *              ./mywc --hash=blake3 release.tar
+ *
+ *      Find the rows of a tab-separated export that do not have 12 fields:
+ *              ./mywc --per-line=12 export.tsv
+ *
+ *      Estimate the prompt tokens of a set of documents:
+ *              ./mywc --tokens=cl100k_base.tiktoken README.md guide.md
+ *
+ *      Check whether a log has at least 1000 lines, without reading all of it:
+ *              ./mywc -l --at-least=1000 huge.log && echo busy
+ *
+ *      Check the length of user names as their users see it:
+ *              ./mywc --graphemes names.txt
+ *
+ *      Find the lines of a log that do not fit in a terminal of 120 columns:
+ *              ./mywc --max-width=120 app.log
+ *
  *      Count the number of lines of each file and totals for both:
  *              ./mywc -l file1.txt file2.txt
  *      
@@ -75,7 +279,7 @@
  *              ./mywc -C
  *
  * SEE ALSO
- *      wc(1), sed(1)
+ *      wc(1), sed(1), and wcrope.h for the same counts of a text that is being edited
  * 
  * EXTRA CREDIT
  *      I found a discrepancy between the UTCS Linux and MacOS wc commands. They do not agree on
@@ -95,12 +299,25 @@
  *      wc command does, the results are different. This seems like a bug. Please take this into consideration
  *      if you see that my output is inconsistent with the UTCS Linux result.
  */
+#define _GNU_SOURCE
 #include "stdio.h"
+#include "stdio_ext.h"
 #include "stdlib.h"
 #include "wctype.h"
 #include "stdbool.h"
 #include "string.h"
 #include "unistd.h"
+#include "limits.h"
+#include "time.h"
+#include "fcntl.h"
+#include "dirent.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "sys/inotify.h"
+#include "poll.h"
+#include "sys/syscall.h"
+#include "sched.h"
+#include "linux/io_uring.h"
 
 bool W = false;
 bool L = false;
@@ -113,131 +330,5013 @@ int TOTAL_WORDS = 0;
 int TOTAL_LINES = 0;
 int TOTAL_CHARS = 0;
 
+/*
+ * USDT probes for bpftrace, perf and SystemTap, built in when sys/sdt.h is there. Each probe is a
+ * nop in the code and a note in the ELF file, and has a semaphore that the tracer raises when it
+ * attaches, so arguments that cost something to compute, such as durations, are only computed then.
+ *
+ *   mywc:file_start(path)                      mywc:file_end(path, bytes, ns)
+ *   mywc:chunk_start(bytes)                    mywc:chunk_end(bytes, ns)
+ *   mywc:cache_hit(cache, bytes)               mywc:cache_miss(cache, bytes)
+ *   mywc:output_flush(bytes)
+ *
+ * The file probes are for files counted with stdio. A chunk is a read of the --io-limit reader or of
+ * --boundaries and --per-line, or an io_uring batch.
+ * The caches are "git" for --git-rev counts and "tokens" for --tokens words. For example:
+ *   bpftrace -e 'usdt:./mywc:mywc:file_end { @ns = hist(arg2); }' -c './mywc big.log'
+ */
+#if defined(__has_include) && __has_include("sys/sdt.h")
+#define _SDT_HAS_SEMAPHORES 1
+#include "sys/sdt.h"
+#define PROBE_SEMAPHORE(name) unsigned short mywc_##name##_semaphore __attribute__((section(".probes"), used));
+#define PROBE_ENABLED(name) __builtin_expect(mywc_##name##_semaphore != 0, 0)
+#define PROBE1(name, a) DTRACE_PROBE1(mywc, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(mywc, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(mywc, name, a, b, c)
+#else
+#define PROBE_SEMAPHORE(name)
+#define PROBE_ENABLED(name) 0
+#define PROBE1(name, a) ((void) (a))
+#define PROBE2(name, a, b) ((void) (a), (void) (b))
+#define PROBE3(name, a, b, c) ((void) (a), (void) (b), (void) (c))
+#endif
+
+PROBE_SEMAPHORE(file_start)
+PROBE_SEMAPHORE(file_end)
+PROBE_SEMAPHORE(chunk_start)
+PROBE_SEMAPHORE(chunk_end)
+PROBE_SEMAPHORE(cache_hit)
+PROBE_SEMAPHORE(cache_miss)
+PROBE_SEMAPHORE(output_flush)
+
+long long now_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*
+ * Byte classes. wc(1) white space is <tab>, <newline>, <vertical-tab>, <form-feed>, <carriage-return>
+ * and <space>; the other classes are for --prose.
+ */
+#define CLASS_SPACE 1
+#define CLASS_NEWLINE 2
+#define CLASS_TERMINAL 4
+#define CLASS_CLOSER 8
+#define CLASS_UPPER 16
+
+static const unsigned char BYTE_CLASS[256] = {
+  ['\t'] = CLASS_SPACE, ['\n'] = CLASS_SPACE | CLASS_NEWLINE, ['\v'] = CLASS_SPACE, ['\f'] = CLASS_SPACE,
+  ['\r'] = CLASS_SPACE, [' '] = CLASS_SPACE, ['.'] = CLASS_TERMINAL, ['!'] = CLASS_TERMINAL,
+  ['?'] = CLASS_TERMINAL, ['"'] = CLASS_CLOSER, ['\''] = CLASS_CLOSER, [')'] = CLASS_CLOSER,
+  [']'] = CLASS_CLOSER, ['A' ... 'Z'] = CLASS_UPPER,
+};
+
 bool wspace(int c) {
-  return (c == 9 || c == 10 || c == 11 || c == 12 || c == 13 || c == 32);
+  return (unsigned int) c < 256 && BYTE_CLASS[c] & CLASS_SPACE;
 }
 
-void wc(char* filename) {
-  int words = 0;
-  int lines = 0;
-  int chars = 0;
-  FILE* file = fopen(filename, "rt");
-  if (file != NULL) {
-    int c;
-    while ((c = fgetc(file)) != EOF) {
-      chars++;
-      if (!iswspace(c)) {
-        while (!iswspace(c = fgetc(file)) && c != EOF) {
-          chars++;
-        }
-        if (wspace(c)) chars++;
-        words++;
-      }
-      if (c == '\n')
-        lines++;
+/*
+ * Heavy-hitter lines for --top-lines. Every line is hashed as wc() reads it, and the hash updates a
+ * Count-Min sketch of CMS_DEPTH rows of CMS_WIDTH counters. The sketch estimate then feeds a
+ * Space-Saving table of TOP_LINES entries: a line missing from a full table evicts the entry with
+ * the smallest count, but only once its own estimate is larger, so a burst of distinct lines cannot
+ * flush the real heavy hitters. Estimates never underestimate. The table is a min-heap by count with
+ * a hash index, so finding a line and evicting the smallest entry both take O(log TOP_LINES) instead
+ * of a scan of the table. Both structures merge, which is how the totals of multiple files are
+ * computed: sketches add up and the candidates of both tables are offered again against the merged
+ * sketch.
+ */
+#define CMS_DEPTH 4
+#define CMS_WIDTH 65536
+#define TOPLINE_TEXT 80
+
+struct sketch {
+  unsigned int counts[CMS_DEPTH][CMS_WIDTH];
+};
+
+struct topline {
+  unsigned long long hash;
+  unsigned int count;
+  int length;
+  unsigned int slot;
+  char text[TOPLINE_TEXT + 1];
+};
+
+// `lines' is a min-heap by count, so the entry to evict is always lines[0], and `index' maps the hash
+// of a line to its place in the heap by open addressing, with -1 for an empty slot. Each line keeps
+// its slot so that the index follows it when the heap moves it.
+struct topk {
+  struct sketch* sketch;
+  struct topline* lines;
+  int* index;
+  unsigned int mask;
+  int size;
+};
+
+int TOP_LINES = 0;
+struct topk FILE_TOPK;
+struct topk TOTAL_TOPK;
+
+unsigned long long LINE_HASH = 14695981039346656037ULL;
+int LINE_LENGTH = 0;
+char LINE_TEXT[TOPLINE_TEXT + 1];
+char* LINE = NULL;
+int LINE_CAPACITY = 0;
+
+void topk_init(struct topk* t) {
+  size_t capacity = 1;
+  while (capacity < 2 * (size_t) TOP_LINES) capacity *= 2;
+  t->sketch = calloc(1, sizeof(struct sketch));
+  t->lines = calloc(TOP_LINES, sizeof(struct topline));
+  t->index = malloc(capacity * sizeof(int));
+  if (t->sketch == NULL || t->lines == NULL || t->index == NULL) exit(EXIT_FAILURE);
+  t->mask = capacity - 1;
+  memset(t->index, -1, capacity * sizeof(int));
+  t->size = 0;
+}
+
+void topk_clear(struct topk* t) {
+  memset(t->sketch, 0, sizeof(struct sketch));
+  memset(t->index, -1, ((size_t) t->mask + 1) * sizeof(int));
+  t->size = 0;
+}
+
+unsigned int sketch_slot(unsigned long long hash, int row) {
+  return (unsigned int) ((hash >> (16 * row)) ^ (hash >> (61 - 3 * row))) % CMS_WIDTH;
+}
+
+unsigned int sketch_add(struct sketch* s, unsigned long long hash, unsigned int n) {
+  unsigned int estimate = 0;
+  int row;
+  for (row = 0; row < CMS_DEPTH; row++) {
+    unsigned int* counter = &s->counts[row][sketch_slot(hash, row)];
+    *counter += n;
+    if (row == 0 || *counter < estimate) estimate = *counter;
+  }
+  return estimate;
+}
+
+unsigned int sketch_estimate(struct sketch* s, unsigned long long hash) {
+  unsigned int estimate = s->counts[0][sketch_slot(hash, 0)];
+  int row;
+  for (row = 1; row < CMS_DEPTH; row++) {
+    unsigned int counter = s->counts[row][sketch_slot(hash, row)];
+    if (counter < estimate) estimate = counter;
+  }
+  return estimate;
+}
+
+unsigned int topk_home(struct topk* t, unsigned long long hash) {
+  return (unsigned int) (hash ^ hash >> 32) & t->mask;
+}
+
+// Returns the index slot that holds a hash, or the empty slot where it would go.
+unsigned int topk_slot(struct topk* t, unsigned long long hash) {
+  unsigned int i = topk_home(t, hash);
+  while (t->index[i] >= 0 && t->lines[t->index[i]].hash != hash) i = (i + 1) & t->mask;
+  return i;
+}
+
+void topk_unindex(struct topk* t, unsigned int hole) {
+  unsigned int i = hole;
+  t->index[hole] = -1;
+  while (t->index[i = (i + 1) & t->mask] >= 0) {
+    unsigned int home = topk_home(t, t->lines[t->index[i]].hash);
+    // The entry may move when the hole is between its home slot and its slot.
+    if (((i - home) & t->mask) >= ((i - hole) & t->mask)) {
+      t->index[hole] = t->index[i];
+      t->lines[t->index[hole]].slot = hole;
+      t->index[i] = -1;
+      hole = i;
     }
-    fclose(file);
-    if (L) printf("      %d", lines);
-    if (W) printf("      %d", words - WORDS_EXCLUDED);
-    if (C) printf("      %d", chars - CHARS_EXCLUDED);
+  }
+}
 
-    TOTAL_WORDS += (words - WORDS_EXCLUDED);
-    TOTAL_LINES += lines;
-    TOTAL_CHARS += (chars - CHARS_EXCLUDED);
+void topk_swap(struct topk* t, int a, int b) {
+  struct topline line = t->lines[a];
+  t->lines[a] = t->lines[b];
+  t->lines[b] = line;
+  t->index[t->lines[a].slot] = a;
+  t->index[t->lines[b].slot] = b;
+}
 
-    WORDS_EXCLUDED = CHARS_EXCLUDED = 0;
+void topk_up(struct topk* t, int i) {
+  while (i > 0 && t->lines[i].count < t->lines[(i - 1) / 2].count) {
+    topk_swap(t, i, (i - 1) / 2);
+    i = (i - 1) / 2;
   }
-  else {
-    exit(EXIT_FAILURE);
+}
+
+void topk_down(struct topk* t, int i) {
+  while (true) {
+    int least = i, child = 2 * i + 1;
+    if (child < t->size && t->lines[child].count < t->lines[least].count) least = child;
+    if (child + 1 < t->size && t->lines[child + 1].count < t->lines[least].count) least = child + 1;
+    if (least == i) return;
+    topk_swap(t, i, least);
+    i = least;
   }
 }
 
-void exclude_comments(char* filename) {
-  FILE* file = fopen(filename, "rb");
-  if (file != NULL) {
-    int c1;
-    int c2;
-    while ((c1 = fgetc(file)) != EOF) {
-      if (c1 == '/' && c2 == '/') {
-        CHARS_EXCLUDED += 2;
-        int c;
-        while((c = fgetc(file)) != '\n' && c != EOF) {
-          CHARS_EXCLUDED++;
-        }
-        c1 = c;
-      }
-      c2 = c1;
+// Space-Saving update with the sketch estimate of a line. The text is only copied when the line
+// enters the table. The estimate of a line never decreases, so a line already in the table can only
+// move down the heap.
+void topk_offer(struct topk* t, unsigned long long hash, unsigned int estimate, char* text, int length) {
+  unsigned int slot = topk_slot(t, hash);
+  int i = t->index[slot];
+  if (i >= 0) {
+    t->lines[i].count = estimate;
+    topk_down(t, i);
+    return;
+  }
+  if (t->size < TOP_LINES) {
+    i = t->size++;
+  } else {
+    if (estimate <= t->lines[0].count) return;
+    i = 0;
+    topk_unindex(t, t->lines[0].slot);
+    slot = topk_slot(t, hash);
+  }
+  t->index[slot] = i;
+  t->lines[i].hash = hash;
+  t->lines[i].count = estimate;
+  t->lines[i].length = length;
+  t->lines[i].slot = slot;
+  memcpy(t->lines[i].text, text, TOPLINE_TEXT + 1);
+  if (i == 0) topk_down(t, 0);
+  else topk_up(t, i);
+}
+
+void topk_merge(struct topk* dst, struct topk* src) {
+  int row, i;
+  for (row = 0; row < CMS_DEPTH; row++) {
+    for (i = 0; i < CMS_WIDTH; i++) {
+      dst->sketch->counts[row][i] += src->sketch->counts[row][i];
     }
-    fclose(file);
   }
-  else {
+  for (i = 0; i < dst->size; i++) {
+    dst->lines[i].count = sketch_estimate(dst->sketch, dst->lines[i].hash);
+  }
+  for (i = dst->size / 2 - 1; i >= 0; i--) topk_down(dst, i);
+  for (i = 0; i < src->size; i++) {
+    struct topline* line = &src->lines[i];
+    topk_offer(dst, line->hash, sketch_estimate(dst->sketch, line->hash), line->text, line->length);
+  }
+}
+
+/*
+ * Line filter for --match. REGEX is compiled into a Thompson NFA whose states either consume a byte
+ * from a 256-bit set or are epsilon moves, or assert that the position is the start (NFA_BOL) or the
+ * end (NFA_EOL) of the line. The DFA is built lazily while lines are matched: a DFA state is the set
+ * of NFA states reached so far, and its transition on a byte is only computed the first time that
+ * byte is seen in that state. An NFA_BOL state is only passed in the closure of the start state, and
+ * NFA_EOL states wait in the set until the end of the line, where `eol_match' tells whether passing
+ * them reaches the match. When DFA_MAX states exist the cache is flushed and
+ * rebuilt on demand, so memory stays bounded for any pattern.
+ *
+ * Before a line reaches the DFA it is checked for the longest literal that every match must contain,
+ * with memmem(), which lets most non-matching lines be rejected without running the automaton.
+ */
+#define NFA_SET 0
+#define NFA_SPLIT 1
+#define NFA_EPSILON 2
+#define NFA_MATCH 3
+#define NFA_BOL 4
+#define NFA_EOL 5
+#define AT_BOL 1
+#define AT_EOL 2
+#define DFA_MAX 1024
+#define DFA_TABLE (2 * DFA_MAX)
+
+struct nfa_state {
+  int type;
+  int out;
+  int out1;
+  unsigned char set[32];
+};
+
+struct nfa_fragment {
+  int start;
+  int end;
+};
+
+struct dfa_state {
+  int* set;
+  int size;
+  bool match;
+  bool eol_match;
+  unsigned int hash;
+  int next[256];
+};
+
+char* MATCH = NULL;
+char MATCH_LITERAL[256];
+int MATCH_LITERAL_LENGTH = 0;
+
+struct nfa_state* NFA = NULL;
+int NFA_SIZE = 0;
+int NFA_CAPACITY = 0;
+int NFA_START;
+char* RE;
+
+struct dfa_state* DFA = NULL;
+int DFA_SIZE = 0;
+int DFA_INDEX[DFA_TABLE];
+int* DFA_WORK;
+int* DFA_EOL_WORK;
+int* NFA_MARK;
+int NFA_GENERATION = 0;
+int DFA_START = -1;
+int DFA_FLUSHES = 0;
+
+int nfa_new(int type, int out, int out1) {
+  if (NFA_SIZE == NFA_CAPACITY) {
+    NFA_CAPACITY = NFA_CAPACITY ? 2 * NFA_CAPACITY : 64;
+    NFA = realloc(NFA, NFA_CAPACITY * sizeof(struct nfa_state));
+    if (NFA == NULL) exit(EXIT_FAILURE);
+  }
+  NFA[NFA_SIZE].type = type;
+  NFA[NFA_SIZE].out = out;
+  NFA[NFA_SIZE].out1 = out1;
+  memset(NFA[NFA_SIZE].set, 0, 32);
+  return NFA_SIZE++;
+}
+
+void set_add(unsigned char* set, int c) {
+  set[c >> 3] |= 1 << (c & 7);
+}
+
+bool set_has(unsigned char* set, int c) {
+  return set[c >> 3] & (1 << (c & 7));
+}
+
+// Adds the byte class of escape `e' (\d, \w, \s and their negations) or the escaped byte itself.
+void set_escape(unsigned char* set, int e) {
+  unsigned char class[32];
+  int c;
+  memset(class, 0, 32);
+  for (c = 0; c < 256; c++) {
+    if ((e == 'd' || e == 'D') && c >= '0' && c <= '9') set_add(class, c);
+    if ((e == 'w' || e == 'W') && (c == '_' || (c >= '0' && c <= '9') || ((c | 32) >= 'a' && (c | 32) <= 'z')))
+      set_add(class, c);
+    if ((e == 's' || e == 'S') && wspace(c)) set_add(class, c);
+  }
+  if (strchr("dws", e)) {
+    for (c = 0; c < 32; c++) set[c] |= class[c];
+  } else if (strchr("DWS", e)) {
+    for (c = 0; c < 32; c++) set[c] |= ~class[c];
+  } else {
+    set_add(set, e == 'n' ? '\n' : e == 't' ? '\t' : e);
+  }
+}
+
+struct nfa_fragment regex_alternation(int depth);
+
+// An atom is a byte, `.', a [class], an escape, an anchor or a (group). `literal' is set when the atom is a
+// single plain byte, for the prefilter.
+struct nfa_fragment regex_atom(int depth, int* literal) {
+  struct nfa_fragment f;
+  bool negate = false;
+  int c;
+  *literal = -1;
+  if (*RE == '(') {
+    RE++;
+    f = regex_alternation(depth + 1);
+    if (*RE++ != ')') exit(EXIT_FAILURE);
+    return f;
+  }
+  f.end = nfa_new(NFA_EPSILON, -1, -1);
+  if (*RE == '^' || *RE == '$') {
+    f.start = nfa_new(*RE++ == '^' ? NFA_BOL : NFA_EOL, f.end, -1);
+    return f;
+  }
+  f.start = nfa_new(NFA_SET, f.end, -1);
+  unsigned char* set = NFA[f.start].set;
+  if (*RE == '.') {
+    RE++;
+    memset(set, 0xff, 32);
+    set['\n' >> 3] &= ~(1 << ('\n' & 7));
+  } else if (*RE == '[') {
+    RE++;
+    if (*RE == '^') {
+      negate = true;
+      RE++;
+    }
+    do {
+      if (*RE == '\0') exit(EXIT_FAILURE);
+      if (*RE == '\\' && RE[1] != '\0') {
+        set_escape(set, (unsigned char) RE[1]);
+        RE += 2;
+      } else if (RE[1] == '-' && RE[2] != ']' && RE[2] != '\0') {
+        for (c = (unsigned char) RE[0]; c <= (unsigned char) RE[2]; c++) set_add(set, c);
+        RE += 3;
+      } else {
+        set_add(set, (unsigned char) *RE++);
+      }
+    } while (*RE != ']');
+    RE++;
+    if (negate) {
+      for (c = 0; c < 32; c++) set[c] = ~set[c];
+    }
+  } else if (*RE == '\\' && RE[1] != '\0') {
+    set_escape(set, (unsigned char) RE[1]);
+    if (!strchr("dwsDWS", RE[1])) *literal = RE[1] == 'n' ? '\n' : RE[1] == 't' ? '\t' : (unsigned char) RE[1];
+    RE += 2;
+  } else if (*RE == '*' || *RE == '+' || *RE == '?') {
     exit(EXIT_FAILURE);
+  } else {
+    *literal = (unsigned char) *RE;
+    set_add(set, (unsigned char) *RE++);
   }
-  
-  file = fopen(filename, "rb");
-  if (file != NULL) {
-    int c; 
-    while ((c = fgetc(file)) != EOF) {
-      if (!wspace(c)) {
-        int c1 = c;
-        int c2;
-        bool no_space_before_comment = false;
-        if (c1 != '/') {
-          no_space_before_comment = true;;
-        } 
-        while (!wspace(c1) && c1 != EOF) {
-          if (c1 == '/' && c2 == '/') {
-            int c3;
-            int c4 = c1;
-            while ((c3 = fgetc(file)) != '\n' && c3 != EOF) {
-              if (!wspace(c4) && wspace(c3)) WORDS_EXCLUDED++;
-              c4 = c3;
-            }
-            if (!wspace(c4)) WORDS_EXCLUDED++;
-            if(no_space_before_comment) WORDS_EXCLUDED--;
-            c1 = c3;
-          }
-          else {
-            c2 = c1;
-            c1 = fgetc(file);
-          }
-        }
+  return f;
+}
+
+struct nfa_fragment regex_repeat(int depth, int* literal) {
+  struct nfa_fragment f = regex_atom(depth, literal);
+  while (*RE == '*' || *RE == '+' || *RE == '?') {
+    int end = nfa_new(NFA_EPSILON, -1, -1);
+    int split = nfa_new(NFA_SPLIT, f.start, end);
+    NFA[f.end].out = *RE == '?' ? end : split;
+    if (*RE != '+') f.start = split;
+    f.end = end;
+    if (*RE != '+') *literal = -1;
+    else if (*literal >= 0) *literal = -2 - *literal;
+    RE++;
+  }
+  return f;
+}
+
+// Concatenation. Runs of plain bytes are collected and the longest one is kept in `best'. A byte
+// repeated with `+' still has to occur once, but ends the run.
+struct nfa_fragment regex_concatenation(int depth, char* best, int* best_length) {
+  struct nfa_fragment f;
+  char run[256];
+  int length = 0;
+  f.start = f.end = nfa_new(NFA_EPSILON, -1, -1);
+  *best_length = 0;
+  while (true) {
+    int literal = -1;
+    bool done = *RE == '\0' || *RE == '|' || *RE == ')';
+    if (!done) {
+      struct nfa_fragment g = regex_repeat(depth, &literal);
+      NFA[f.end].out = g.start;
+      f.end = g.end;
+      if (literal != -1 && length < 255) run[length++] = literal >= 0 ? literal : -2 - literal;
+    }
+    if (literal < 0 && length > *best_length) {
+      *best_length = length;
+      memcpy(best, run, length);
+    }
+    if (literal < 0) length = 0;
+    if (done) return f;
+  }
+}
+
+// Alternation. Only a top-level pattern without `|' has a literal every match must contain.
+struct nfa_fragment regex_alternation(int depth) {
+  char best[256];
+  int best_length;
+  bool alternatives = false;
+  struct nfa_fragment f = regex_concatenation(depth, best, &best_length);
+  if (depth == 0) {
+    memcpy(MATCH_LITERAL, best, best_length);
+    MATCH_LITERAL_LENGTH = best_length;
+  }
+  while (*RE == '|') {
+    RE++;
+    struct nfa_fragment g = regex_concatenation(depth, best, &best_length);
+    int end = nfa_new(NFA_EPSILON, -1, -1);
+    f.start = nfa_new(NFA_SPLIT, f.start, g.start);
+    NFA[f.end].out = end;
+    NFA[g.end].out = end;
+    f.end = end;
+    alternatives = true;
+  }
+  if (alternatives && depth == 0) MATCH_LITERAL_LENGTH = 0;
+  return f;
+}
+
+// Adds the states reached from s by epsilon moves and by the assertions that hold at `position', a
+// combination of AT_BOL and AT_EOL. An NFA_EOL that does not hold yet is kept in the set.
+void closure_add(int s, int* set, int* size, int position) {
+  while (s >= 0 && NFA_MARK[s] != NFA_GENERATION) {
+    NFA_MARK[s] = NFA_GENERATION;
+    if (NFA[s].type == NFA_SPLIT) {
+      closure_add(NFA[s].out1, set, size, position);
+    } else if (NFA[s].type == NFA_BOL) {
+      if (!(position & AT_BOL)) return;
+    } else if (NFA[s].type == NFA_EOL) {
+      if (!(position & AT_EOL)) {
+        set[(*size)++] = s;
+        return;
       }
+    } else if (NFA[s].type != NFA_EPSILON) {
+      set[(*size)++] = s;
+      return;
     }
-    fclose(file);
+    s = NFA[s].out;
   }
-  else {
-    exit(EXIT_FAILURE);
+}
+
+int int_compare(const void* a, const void* b) {
+  return *(const int*) a - *(const int*) b;
+}
+
+void dfa_flush() {
+  int i;
+  for (i = 0; i < DFA_SIZE; i++) free(DFA[i].set);
+  DFA_SIZE = 0;
+  DFA_START = -1;
+  DFA_FLUSHES++;
+  for (i = 0; i < DFA_TABLE; i++) DFA_INDEX[i] = -1;
+}
+
+// Returns the DFA state of the NFA state set, creating it if needed.
+int dfa_state(int* set, int size) {
+  unsigned int hash = 2166136261u;
+  int i, slot;
+  qsort(set, size, sizeof(int), int_compare);
+  for (i = 0; i < size; i++) hash = (hash ^ set[i]) * 16777619u;
+  for (slot = hash % DFA_TABLE; DFA_INDEX[slot] >= 0; slot = (slot + 1) % DFA_TABLE) {
+    struct dfa_state* d = &DFA[DFA_INDEX[slot]];
+    if (d->hash == hash && d->size == size && memcmp(d->set, set, size * sizeof(int)) == 0)
+      return DFA_INDEX[slot];
+  }
+  if (DFA_SIZE == DFA_MAX) {
+    dfa_flush();
+    return dfa_state(set, size);
   }
+  struct dfa_state* d = &DFA[DFA_SIZE];
+  d->set = malloc((size + 1) * sizeof(int));
+  if (d->set == NULL) exit(EXIT_FAILURE);
+  memcpy(d->set, set, size * sizeof(int));
+  d->size = size;
+  d->hash = hash;
+  d->match = false;
+  for (i = 0; i < size; i++) {
+    if (NFA[set[i]].type == NFA_MATCH) d->match = true;
+  }
+  int eol_size = 0;
+  NFA_GENERATION++;
+  for (i = 0; i < size; i++) {
+    if (NFA[set[i]].type == NFA_EOL) closure_add(NFA[set[i]].out, DFA_EOL_WORK, &eol_size, AT_EOL);
+  }
+  d->eol_match = d->match;
+  for (i = 0; i < eol_size; i++) {
+    if (NFA[DFA_EOL_WORK[i]].type == NFA_MATCH) d->eol_match = true;
+  }
+  for (i = 0; i < 256; i++) d->next[i] = -1;
+  DFA_INDEX[slot] = DFA_SIZE;
+  return DFA_SIZE++;
+}
 
+int dfa_start() {
+  int size = 0;
+  if (DFA_START < 0) {
+    NFA_GENERATION++;
+    closure_add(NFA_START, DFA_WORK, &size, AT_BOL);
+    DFA_START = dfa_state(DFA_WORK, size);
+  }
+  return DFA_START;
 }
 
-int main(int argc, char* argv[], char* env[]) {
+// Computes the transition of state d on byte c. The start state is added back at every position,
+// which makes the search unanchored; past the first byte, its NFA_BOL states no longer hold.
+int dfa_step(int d, int c) {
+  int size = 0;
   int i;
-  if (argc == 1 || (argc > 1 && (argv[1][0] != '-' || strcmp(argv[1], "-C") == 0))) W = L = C = true;
-  bool ellide_comments = false;
-  int numfiles = 0;
-  for (i = 1; i < argc; i++) {
-    int j;
-    char* arg = argv[i];
-    if (arg[0] == '-') {
-      for (j = 1; j < strlen(arg); j++) {
-        if (arg[j] == 'C') ellide_comments = true;
-        else if (arg[j] == 'w') W = true;
-        else if (arg[j] == 'l') L = true;
-        else if (arg[j] == 'c') C = true;
+  NFA_GENERATION++;
+  for (i = 0; i < DFA[d].size; i++) {
+    struct nfa_state* s = &NFA[DFA[d].set[i]];
+    if (s->type == NFA_SET && set_has(s->set, c)) closure_add(s->out, DFA_WORK, &size, 0);
+  }
+  closure_add(NFA_START, DFA_WORK, &size, 0);
+  int flushes = DFA_FLUSHES;
+  int next = dfa_state(DFA_WORK, size);
+  if (flushes == DFA_FLUSHES) DFA[d].next[c] = next;
+  return next;
+}
+
+void regex_compile(char* pattern) {
+  MATCH = pattern;
+  RE = pattern;
+  struct nfa_fragment f = regex_alternation(0);
+  if (*RE != '\0') exit(EXIT_FAILURE);
+  NFA[f.end].out = nfa_new(NFA_MATCH, -1, -1);
+  NFA_START = f.start;
+  NFA_MARK = calloc(NFA_SIZE, sizeof(int));
+  DFA_WORK = malloc(NFA_SIZE * sizeof(int));
+  DFA_EOL_WORK = malloc(NFA_SIZE * sizeof(int));
+  DFA = malloc(DFA_MAX * sizeof(struct dfa_state));
+  if (NFA_MARK == NULL || DFA_WORK == NULL || DFA_EOL_WORK == NULL || DFA == NULL) exit(EXIT_FAILURE);
+  dfa_flush();
+}
+
+bool regex_match(char* line, int length) {
+  int i;
+  if (MATCH_LITERAL_LENGTH > 0 && memmem(line, length, MATCH_LITERAL, MATCH_LITERAL_LENGTH) == NULL)
+    return false;
+  // An empty line is both its start and its end, so every anchor holds at once.
+  if (length == 0) {
+    int size = 0;
+    NFA_GENERATION++;
+    closure_add(NFA_START, DFA_EOL_WORK, &size, AT_BOL | AT_EOL);
+    for (i = 0; i < size; i++) {
+      if (NFA[DFA_EOL_WORK[i]].type == NFA_MATCH) return true;
+    }
+    return false;
+  }
+  int d = dfa_start();
+  for (i = 0; i < length; i++) {
+    if (DFA[d].match) return true;
+    if (DFA[d].size == 0) return false;
+    int next = DFA[d].next[(unsigned char) line[i]];
+    d = next >= 0 ? next : dfa_step(d, (unsigned char) line[i]);
+  }
+  return DFA[d].eol_match;
+}
+
+/*
+ * Time buckets for --bucket-by. The leading timestamp of every counted line is parsed in the
+ * format BUCKET_FORMAT and the line and its bytes are added to the bucket of BUCKET_WIDTH seconds
+ * it falls in. The digits of a timestamp are packed into 64-bit words and converted eight at a time
+ * (SWAR), instead of one multiply-add per digit. Buckets live in an open-addressing table keyed by
+ * bucket start, and the tables of all files are merged for the total.
+ */
+#define BUCKET_ISO8601 1
+#define BUCKET_EPOCH 2
+#define BUCKET_SYSLOG 3
+#define BUCKET_UNPARSED LLONG_MIN
+
+struct bucket {
+  long long start;
+  int lines;
+  long long bytes;
+};
+
+struct buckets {
+  struct bucket* slots;
+  int size;
+  int capacity;
+};
+
+int BUCKET_FORMAT = 0;
+long long BUCKET_WIDTH = 60;
+int SYSLOG_YEAR;
+struct buckets FILE_BUCKETS;
+struct buckets TOTAL_BUCKETS;
+
+// Every byte is a digit when its high nibble is 3 and adding 6 does not carry out of the nibble.
+bool digits_valid(unsigned long long x) {
+  unsigned long long high = x & 0xf0f0f0f0f0f0f0f0ULL;
+  unsigned long long carry = (x + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL;
+  return (high | (carry >> 4)) == 0x3333333333333333ULL;
+}
+
+// Converts the 8 ASCII digits in x, most significant digit in the lowest byte.
+unsigned int digits8(unsigned long long x) {
+  x = (x & 0x0f0f0f0f0f0f0f0fULL) * 2561 >> 8;
+  x = (x & 0x00ff00ff00ff00ffULL) * 6553601 >> 16;
+  return (unsigned int) ((x & 0x0000ffff0000ffffULL) * 42949672960001ULL >> 32);
+}
+
+// Converts n <= 8 ASCII digits, or returns -1 if one of them is not a digit. Missing leading
+// digits are filled with `0'.
+long long parse_digits(char* s, int n) {
+  unsigned long long x = 0x3030303030303030ULL;
+  memcpy((char*) &x + 8 - n, s, n);
+  if (!digits_valid(x)) return -1;
+  return digits8(x);
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date.
+long long days_from_civil(long long y, int m, int d) {
+  y -= m <= 2;
+  long long era = (y >= 0 ? y : y - 399) / 400;
+  long long yoe = y - era * 400;
+  long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+int days_in_month(long long y, int m) {
+  static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  if (m == 2 && y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)) return 29;
+  return days[m - 1];
+}
+
+long long seconds_from_civil(long long y, int mo, int d, int h, int mi, int s) {
+  if (mo < 1 || mo > 12 || d < 1 || d > days_in_month(y, mo) || h > 23 || mi > 59 || s > 60)
+    return BUCKET_UNPARSED;
+  return days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + s;
+}
+
+// YYYY-MM-DD[T ]HH:MM:SS[.fraction][Z|+HH:MM|-HH:MM]
+long long parse_iso8601(char* s, int n) {
+  char digits[16];
+  if (n < 19 || s[4] != '-' || s[7] != '-' || (s[10] != 'T' && s[10] != ' ') || s[13] != ':' || s[16] != ':')
+    return BUCKET_UNPARSED;
+  memcpy(digits, s, 4);
+  memcpy(digits + 4, s + 5, 2);
+  memcpy(digits + 6, s + 8, 2);
+  memcpy(digits + 8, s + 11, 2);
+  memcpy(digits + 10, s + 14, 2);
+  memcpy(digits + 12, s + 17, 2);
+  memcpy(digits + 14, "00", 2);
+  long long date = parse_digits(digits, 8);
+  long long time = parse_digits(digits + 8, 8);
+  if (date < 0 || time < 0) return BUCKET_UNPARSED;
+  long long t = seconds_from_civil(date / 10000, date / 100 % 100, date % 100,
+                                   time / 1000000, time / 10000 % 100, time / 100 % 100);
+  if (t == BUCKET_UNPARSED) return t;
+  int i = 19;
+  if (i < n && (s[i] == '.' || s[i] == ',')) {
+    for (i++; i < n && s[i] >= '0' && s[i] <= '9'; i++) {}
+  }
+  if (i + 6 <= n && (s[i] == '+' || s[i] == '-') && s[i + 3] == ':') {
+    long long hours = parse_digits(s + i + 1, 2);
+    long long minutes = parse_digits(s + i + 4, 2);
+    if (hours < 0 || minutes < 0) return BUCKET_UNPARSED;
+    long long offset = hours * 3600 + minutes * 60;
+    t += s[i] == '+' ? -offset : offset;
+  }
+  return t;
+}
+
+// Seconds, milliseconds, microseconds or nanoseconds since the epoch, told apart by length.
+long long parse_epoch(char* s, int n) {
+  int digits = 0;
+  long long t = 0;
+  while (digits < n && digits < 19 && s[digits] >= '0' && s[digits] <= '9') digits++;
+  if (digits < 9 || (digits > 10 && digits != 13 && digits != 16 && digits != 19)) return BUCKET_UNPARSED;
+  int i = 0;
+  for (; i + 8 <= digits; i += 8) t = t * 100000000 + parse_digits(s + i, 8);
+  if (i < digits) {
+    long long p = 1;
+    int k;
+    for (k = i; k < digits; k++) p *= 10;
+    t = t * p + parse_digits(s + i, digits - i);
+  }
+  while (digits > 10) {
+    t /= 1000;
+    digits -= 3;
+  }
+  return t;
+}
+
+// Mmm dd HH:MM:SS, where the day may be padded with a space. Syslog omits the year, so the
+// current year is assumed.
+long long parse_syslog(char* s, int n) {
+  static const char* months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char digits[8];
+  int month;
+  if (n < 15 || s[3] != ' ' || s[6] != ' ' || s[9] != ':' || s[12] != ':') return BUCKET_UNPARSED;
+  for (month = 0; month < 12 && memcmp(months + 3 * month, s, 3) != 0; month++) {}
+  if (month == 12) return BUCKET_UNPARSED;
+  digits[0] = s[4] == ' ' ? '0' : s[4];
+  digits[1] = s[5];
+  memcpy(digits + 2, s + 7, 2);
+  memcpy(digits + 4, s + 10, 2);
+  memcpy(digits + 6, s + 13, 2);
+  long long t = parse_digits(digits, 8);
+  if (t < 0) return BUCKET_UNPARSED;
+  return seconds_from_civil(SYSLOG_YEAR, month + 1, t / 1000000, t / 10000 % 100, t / 100 % 100, t % 100);
+}
+
+long long parse_timestamp(char* s, int n) {
+  if (n > 0 && s[0] == '[') {
+    s++;
+    n--;
+  }
+  if (BUCKET_FORMAT == BUCKET_ISO8601) return parse_iso8601(s, n);
+  if (BUCKET_FORMAT == BUCKET_EPOCH) return parse_epoch(s, n);
+  return parse_syslog(s, n);
+}
+
+void buckets_init(struct buckets* b) {
+  b->size = 0;
+  b->capacity = 1024;
+  b->slots = malloc(b->capacity * sizeof(struct bucket));
+  if (b->slots == NULL) exit(EXIT_FAILURE);
+  memset(b->slots, 0, b->capacity * sizeof(struct bucket));
+}
+
+void buckets_clear(struct buckets* b) {
+  memset(b->slots, 0, b->capacity * sizeof(struct bucket));
+  b->size = 0;
+}
+
+void buckets_add(struct buckets* b, long long start, int lines, long long bytes);
+
+void buckets_grow(struct buckets* b) {
+  struct buckets old = *b;
+  int i;
+  b->size = 0;
+  b->capacity *= 2;
+  b->slots = calloc(b->capacity, sizeof(struct bucket));
+  if (b->slots == NULL) exit(EXIT_FAILURE);
+  for (i = 0; i < old.capacity; i++) {
+    if (old.slots[i].lines > 0) buckets_add(b, old.slots[i].start, old.slots[i].lines, old.slots[i].bytes);
+  }
+  free(old.slots);
+}
+
+void buckets_add(struct buckets* b, long long start, int lines, long long bytes) {
+  unsigned long long hash = (unsigned long long) start * 0x9e3779b97f4a7c15ULL;
+  int i = (int) (hash >> 32) & (b->capacity - 1);
+  while (b->slots[i].lines > 0 && b->slots[i].start != start) i = (i + 1) & (b->capacity - 1);
+  if (b->slots[i].lines == 0) {
+    if (2 * (b->size + 1) > b->capacity) {
+      buckets_grow(b);
+      buckets_add(b, start, lines, bytes);
+      return;
+    }
+    b->slots[i].start = start;
+    b->size++;
+  }
+  b->slots[i].lines += lines;
+  b->slots[i].bytes += bytes;
+}
+
+void buckets_merge(struct buckets* dst, struct buckets* src) {
+  int i;
+  for (i = 0; i < src->capacity; i++) {
+    if (src->slots[i].lines > 0) buckets_add(dst, src->slots[i].start, src->slots[i].lines, src->slots[i].bytes);
+  }
+}
+
+void bucket_line(char* line, int length, long long bytes) {
+  long long t = parse_timestamp(line, length);
+  if (t != BUCKET_UNPARSED) {
+    long long start = t - t % BUCKET_WIDTH;
+    if (t < 0 && t % BUCKET_WIDTH != 0) start -= BUCKET_WIDTH;
+    t = start;
+  }
+  buckets_add(&FILE_BUCKETS, t, 1, bytes);
+}
+
+int bucket_compare(const void* a, const void* b) {
+  const struct bucket* x = a;
+  const struct bucket* y = b;
+  return (x->start > y->start) - (x->start < y->start);
+}
+
+// Writes the lines and bytes of every bucket in time order. Lines without a timestamp are
+// reported last, with `-' in place of the time.
+void report_buckets(struct buckets* b) {
+  struct bucket* sorted = malloc((b->size + 1) * sizeof(struct bucket));
+  int i, n = 0;
+  if (sorted == NULL) exit(EXIT_FAILURE);
+  for (i = 0; i < b->capacity; i++) {
+    if (b->slots[i].lines > 0) sorted[n++] = b->slots[i];
+  }
+  qsort(sorted, n, sizeof(struct bucket), bucket_compare);
+  for (i = 0; i < n; i++) {
+    if (sorted[i].start == BUCKET_UNPARSED) continue;
+    char when[32];
+    time_t t = (time_t) sorted[i].start;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("      %d      %lld %s\n", sorted[i].lines, sorted[i].bytes, when);
+  }
+  if (n > 0 && sorted[0].start == BUCKET_UNPARSED) printf("      %d      %lld -\n", sorted[0].lines, sorted[0].bytes);
+  free(sorted);
+}
+
+/*
+ * Record validation for --jsonl. A line is validated in two stages, like simdjson. The first stage
+ * classifies each 64-byte block into bit masks: backslashes, quotes, whitespace and the operators
+ * {}[]:,. The escaped characters follow from runs of backslashes with odd length, and a prefix XOR of
+ * the unescaped quotes gives the bytes inside strings. What remains is a list of structural tokens:
+ * operators outside strings, both quotes of every string and the first byte of every scalar. The
+ * second stage checks the grammar of that list with a stack, and the scalars and escapes it meets.
+ * Newlines escaped inside strings stay part of their record.
+ */
+#define JSON_DEPTH 1024
+
+struct json_key {
+  char* name;
+  int count;
+};
+
+struct json_keys {
+  struct json_key* slots;
+  int size;
+  int capacity;
+};
+
+bool JSONL = false;
+bool JSONL_KEYS = false;
+int JSON_RECORDS = 0;
+int JSON_MALFORMED = 0;
+int TOTAL_JSON_RECORDS = 0;
+int TOTAL_JSON_MALFORMED = 0;
+struct json_keys FILE_KEYS;
+struct json_keys TOTAL_KEYS;
+
+int* JSON_TOKENS = NULL;
+int JSON_TOKENS_CAPACITY = 0;
+int* JSON_KEY_TOKENS = NULL;
+int JSON_KEYS_FOUND;
+
+void json_keys_init(struct json_keys* k) {
+  k->size = 0;
+  k->capacity = 64;
+  k->slots = calloc(k->capacity, sizeof(struct json_key));
+  if (k->slots == NULL) exit(EXIT_FAILURE);
+}
+
+void json_keys_clear(struct json_keys* k) {
+  int i;
+  for (i = 0; i < k->capacity; i++) free(k->slots[i].name);
+  memset(k->slots, 0, k->capacity * sizeof(struct json_key));
+  k->size = 0;
+}
+
+void json_keys_add(struct json_keys* k, char* name, int length, int count) {
+  unsigned int hash = 2166136261u;
+  int i;
+  for (i = 0; i < length; i++) hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+  for (i = hash & (k->capacity - 1); k->slots[i].name != NULL; i = (i + 1) & (k->capacity - 1)) {
+    if (strncmp(k->slots[i].name, name, length) == 0 && k->slots[i].name[length] == '\0') {
+      k->slots[i].count += count;
+      return;
+    }
+  }
+  if (2 * (k->size + 1) > k->capacity) {
+    struct json_keys old = *k;
+    k->size = 0;
+    k->capacity *= 2;
+    k->slots = calloc(k->capacity, sizeof(struct json_key));
+    if (k->slots == NULL) exit(EXIT_FAILURE);
+    for (i = 0; i < old.capacity; i++) {
+      if (old.slots[i].name != NULL) {
+        json_keys_add(k, old.slots[i].name, strlen(old.slots[i].name), old.slots[i].count);
+        free(old.slots[i].name);
       }
-    } else {
-      numfiles++;
-      if (ellide_comments) exclude_comments(arg);
-      wc(arg);
-      printf(" %s\n", arg);
     }
+    free(old.slots);
+    json_keys_add(k, name, length, count);
+    return;
   }
+  k->slots[i].name = strndup(name, length);
+  if (k->slots[i].name == NULL) exit(EXIT_FAILURE);
+  k->slots[i].count = count;
+  k->size++;
+}
+
+void json_keys_merge(struct json_keys* dst, struct json_keys* src) {
+  int i;
+  for (i = 0; i < src->capacity; i++) {
+    if (src->slots[i].name != NULL)
+      json_keys_add(dst, src->slots[i].name, strlen(src->slots[i].name), src->slots[i].count);
+  }
+}
+
+unsigned long long prefix_xor(unsigned long long x) {
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
 
-  if (numfiles > 1) printf("      %d      %d      %d total\n", TOTAL_LINES, TOTAL_WORDS, TOTAL_CHARS);
+bool hex_digit(int c) {
+  return (c >= '0' && c <= '9') || ((c | 32) >= 'a' && (c | 32) <= 'f');
+}
+
+bool json_escape_valid(char* line, int length, int i) {
+  int k;
+  if (strchr("\"\\/bfnrt", line[i]) != NULL && line[i] != '\0') return true;
+  if (line[i] != 'u' || i + 4 >= length) return false;
+  for (k = 1; k <= 4; k++) {
+    if (!hex_digit((unsigned char) line[i + k])) return false;
+  }
+  return true;
+}
+
+// Returns the number of tokens, or -1 if the line cannot be valid JSON.
+int json_stage1(char* line, int length) {
+  unsigned long long prev_escaped = 0;
+  unsigned long long prev_in_string = 0;
+  unsigned long long prev_scalar = 0;
+  int tokens = 0;
+  int base;
+  for (base = 0; base < length; base += 64) {
+    unsigned long long backslash = 0, quote = 0, space = 0, op = 0, control = 0;
+    int n = length - base < 64 ? length - base : 64;
+    int i;
+    for (i = 0; i < n; i++) {
+      unsigned char c = line[base + i];
+      unsigned long long bit = 1ULL << i;
+      if (c == '\\') backslash |= bit;
+      if (c == '"') quote |= bit;
+      if (c == ' ' || c == '\t' || c == '\r' || c == '\n') space |= bit;
+      if (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',') op |= bit;
+      if (c < 0x20) control |= bit;
+    }
+    if (n < 64) space |= ~0ULL << n;
+
+    // Escaped characters follow backslash runs of odd length.
+    const unsigned long long even_bits = 0x5555555555555555ULL;
+    backslash &= ~prev_escaped;
+    unsigned long long follows_escape = backslash << 1 | prev_escaped;
+    unsigned long long odd_starts = backslash & ~even_bits & ~follows_escape;
+    unsigned long long even_sequences = odd_starts + backslash;
+    prev_escaped = even_sequences < odd_starts;
+    unsigned long long escaped = (even_bits ^ (even_sequences << 1)) & follows_escape;
+
+    quote &= ~escaped;
+    unsigned long long in_string = prefix_xor(quote) ^ prev_in_string;
+    prev_in_string = 0ULL - (in_string >> 63);
+    unsigned long long outside = ~in_string & ~quote;
+    if (control & (in_string & ~quote)) return -1;
+    unsigned long long scalar = outside & ~op & ~space;
+    unsigned long long structural = (op & outside) | quote | (scalar & ~(scalar << 1 | prev_scalar));
+    prev_scalar = scalar >> 63;
+
+    for (; escaped != 0; escaped &= escaped - 1) {
+      int at = base + __builtin_ctzll(escaped);
+      if (at < length && !json_escape_valid(line, length, at)) return -1;
+    }
+    if (tokens + 64 > JSON_TOKENS_CAPACITY) {
+      JSON_TOKENS_CAPACITY = 2 * JSON_TOKENS_CAPACITY + 64;
+      JSON_TOKENS = realloc(JSON_TOKENS, JSON_TOKENS_CAPACITY * sizeof(int));
+      JSON_KEY_TOKENS = realloc(JSON_KEY_TOKENS, JSON_TOKENS_CAPACITY * sizeof(int));
+      if (JSON_TOKENS == NULL || JSON_KEY_TOKENS == NULL) exit(EXIT_FAILURE);
+    }
+    for (; structural != 0; structural &= structural - 1) {
+      JSON_TOKENS[tokens++] = base + __builtin_ctzll(structural);
+    }
+  }
+  if (prev_in_string) return -1;
+  return tokens;
+}
+
+// Checks the scalar starting at line[i], which runs until whitespace or an operator.
+bool json_scalar_valid(char* line, int length, int i) {
+  int end = i;
+  while (end < length && !strchr(" \t\r\n{}[]:,\"", line[end])) end++;
+  int n = end - i;
+  char* s = line + i;
+  if ((n == 4 && memcmp(s, "true", 4) == 0) || (n == 4 && memcmp(s, "null", 4) == 0) ||
+      (n == 5 && memcmp(s, "false", 5) == 0))
+    return true;
+  int k = 0;
+  if (k < n && s[k] == '-') k++;
+  if (k < n && s[k] == '0') {
+    k++;
+  } else if (k < n && s[k] >= '1' && s[k] <= '9') {
+    while (k < n && s[k] >= '0' && s[k] <= '9') k++;
+  } else {
+    return false;
+  }
+  if (k < n && s[k] == '.') {
+    k++;
+    if (k == n || s[k] < '0' || s[k] > '9') return false;
+    while (k < n && s[k] >= '0' && s[k] <= '9') k++;
+  }
+  if (k < n && (s[k] == 'e' || s[k] == 'E')) {
+    k++;
+    if (k < n && (s[k] == '+' || s[k] == '-')) k++;
+    if (k == n || s[k] < '0' || s[k] > '9') return false;
+    while (k < n && s[k] >= '0' && s[k] <= '9') k++;
+  }
+  return k == n;
+}
+
+#define JSON_VALUE 0
+#define JSON_VALUE_OR_CLOSE 1
+#define JSON_KEY 2
+#define JSON_KEY_OR_CLOSE 3
+#define JSON_AFTER_VALUE 4
+#define JSON_END 5
+
+// Walks the tokens of stage 1 and checks the grammar. The tokens of the keys of a top-level object
+// are kept in JSON_KEY_TOKENS, to be counted if the record turns out valid.
+bool json_stage2(char* line, int length, int tokens) {
+  char stack[JSON_DEPTH];
+  int depth = 0;
+  int state = JSON_VALUE;
+  int t;
+  JSON_KEYS_FOUND = 0;
+  for (t = 0; t < tokens; t++) {
+    int at = JSON_TOKENS[t];
+    char c = line[at];
+    if (state == JSON_END) return false;
+    if (state == JSON_VALUE_OR_CLOSE && c == ']') {
+      depth--;
+    } else if (state == JSON_KEY_OR_CLOSE && c == '}') {
+      depth--;
+    } else if (state == JSON_VALUE || state == JSON_VALUE_OR_CLOSE) {
+      if (c == '{' || c == '[') {
+        if (depth == JSON_DEPTH) return false;
+        stack[depth++] = c;
+        state = c == '{' ? JSON_KEY_OR_CLOSE : JSON_VALUE_OR_CLOSE;
+        continue;
+      }
+      if (c == '"') t++;
+      else if (strchr("{}[]:,", c) != NULL || !json_scalar_valid(line, length, at)) return false;
+    } else if (state == JSON_KEY || state == JSON_KEY_OR_CLOSE) {
+      if (c != '"' || t + 2 >= tokens || line[JSON_TOKENS[t + 2]] != ':') return false;
+      if (depth == 1) JSON_KEY_TOKENS[JSON_KEYS_FOUND++] = t;
+      t += 2;
+      state = JSON_VALUE;
+      continue;
+    } else if (c == ',') {
+      state = stack[depth - 1] == '{' ? JSON_KEY : JSON_VALUE;
+      continue;
+    } else if (c == (stack[depth - 1] == '{' ? '}' : ']')) {
+      depth--;
+    } else {
+      return false;
+    }
+    state = depth == 0 ? JSON_END : JSON_AFTER_VALUE;
+  }
+  return state == JSON_END;
+}
+
+void jsonl_line(char* line, int length) {
+  int i = 0;
+  while (i < length && strchr(" \t\r", line[i]) != NULL) i++;
+  if (i == length) return;
+  int tokens = json_stage1(line, length);
+  if (tokens < 0 || !json_stage2(line, length, tokens)) {
+    JSON_MALFORMED++;
+    return;
+  }
+  JSON_RECORDS++;
+  if (JSONL_KEYS) {
+    for (i = 0; i < JSON_KEYS_FOUND; i++) {
+      int t = JSON_KEY_TOKENS[i];
+      int at = JSON_TOKENS[t];
+      json_keys_add(&FILE_KEYS, line + at + 1, JSON_TOKENS[t + 1] - at - 1, 1);
+    }
+  }
+}
+
+int json_key_compare(const void* a, const void* b) {
+  const struct json_key* x = a;
+  const struct json_key* y = b;
+  if (x->count != y->count) return (x->count < y->count) - (x->count > y->count);
+  return strcmp(x->name, y->name);
+}
+
+void report_jsonl(int records, int malformed, struct json_keys* k) {
+  printf("      %d records      %d malformed\n", records, malformed);
+  if (JSONL_KEYS) {
+    struct json_key* sorted = malloc((k->size + 1) * sizeof(struct json_key));
+    int i, n = 0;
+    if (sorted == NULL) exit(EXIT_FAILURE);
+    for (i = 0; i < k->capacity; i++) {
+      if (k->slots[i].name != NULL) sorted[n++] = k->slots[i];
+    }
+    qsort(sorted, n, sizeof(struct json_key), json_key_compare);
+    for (i = 0; i < n; i++) printf("      %d  \"%s\"\n", sorted[i].count, sorted[i].name);
+    free(sorted);
+  }
+}
+
+void line_byte(int c) {
+  if (TOP_LINES) LINE_HASH = (LINE_HASH ^ (unsigned char) c) * 1099511628211ULL;
+  if ((TOP_LINES || BUCKET_FORMAT) && LINE_LENGTH < TOPLINE_TEXT) LINE_TEXT[LINE_LENGTH] = c;
+  if (MATCH || JSONL) {
+    if (LINE_LENGTH == LINE_CAPACITY) {
+      LINE_CAPACITY = LINE_CAPACITY ? 2 * LINE_CAPACITY : 4096;
+      LINE = realloc(LINE, LINE_CAPACITY);
+      if (LINE == NULL) exit(EXIT_FAILURE);
+    }
+    LINE[LINE_LENGTH] = c;
+  }
+  LINE_LENGTH++;
+}
+
+// Called at the end of every line, returns whether the line contributes to the counts. A last line
+// without a <newline> is not `terminated'.
+bool line_end(bool terminated) {
+  bool counted = MATCH == NULL || regex_match(LINE, LINE_LENGTH);
+  if (counted && BUCKET_FORMAT)
+    bucket_line(LINE_TEXT, LINE_LENGTH < TOPLINE_TEXT ? LINE_LENGTH : TOPLINE_TEXT, LINE_LENGTH + terminated);
+  if (counted && JSONL) jsonl_line(LINE, LINE_LENGTH);
+  if (counted && TOP_LINES && LINE_LENGTH > 0) {
+    LINE_TEXT[LINE_LENGTH < TOPLINE_TEXT ? LINE_LENGTH : TOPLINE_TEXT] = '\0';
+    unsigned int estimate = sketch_add(FILE_TOPK.sketch, LINE_HASH, 1);
+    topk_offer(&FILE_TOPK, LINE_HASH, estimate, LINE_TEXT, LINE_LENGTH);
+  }
+  LINE_HASH = 14695981039346656037ULL;
+  LINE_LENGTH = 0;
+  return counted;
+}
+
+int topline_compare(const void* a, const void* b) {
+  const struct topline* x = a;
+  const struct topline* y = b;
+  return (x->count < y->count) - (x->count > y->count);
+}
+
+// Writes the lines most frequent first, from a sorted copy that leaves the heap as it is.
+void report_top_lines(struct topk* t) {
+  struct topline* sorted = malloc(t->size * sizeof(struct topline));
+  int i;
+  if (sorted == NULL && t->size > 0) exit(EXIT_FAILURE);
+  if (t->size > 0) memcpy(sorted, t->lines, t->size * sizeof(struct topline));
+  qsort(sorted, t->size, sizeof(struct topline), topline_compare);
+  for (i = 0; i < t->size; i++) {
+    printf("      %u  %s%s\n", sorted[i].count, sorted[i].text, sorted[i].length > TOPLINE_TEXT ? "..." : "");
+  }
+  free(sorted);
+}
+
+/*
+ * Spans for --trace, written at exit as Chrome trace-event JSON for Perfetto or chrome://tracing.
+ * Each thread records into its own ring of TRACE_EVENTS spans, so recording takes no lock; when the
+ * ring is full the oldest spans are overwritten. A span is two clock readings and a copy of at most
+ * TRACE_DETAIL bytes of its file name, taken per file or per read and never per byte.
+ */
+#define TRACE_EVENTS 32768
+#define TRACE_DETAIL 48
+
+struct trace_event {
+  const char* name;
+  long long start;
+  long long end;
+  long long bytes;
+  char detail[TRACE_DETAIL];
+};
+
+struct trace_ring {
+  struct trace_event* events;
+  unsigned long long next;
+  int tid;
+};
+
+char* TRACE_FILE = NULL;
+__thread struct trace_ring TRACE;
+
+long long trace_start() {
+  return TRACE_FILE == NULL ? 0 : now_ns();
+}
+
+void trace_span(const char* name, long long start, const char* detail, long long bytes) {
+  if (TRACE_FILE == NULL) return;
+  if (TRACE.events == NULL) {
+    TRACE.events = malloc(TRACE_EVENTS * sizeof(struct trace_event));
+    if (TRACE.events == NULL) exit(EXIT_FAILURE);
+    TRACE.tid = syscall(SYS_gettid);
+  }
+  struct trace_event* e = &TRACE.events[TRACE.next++ % TRACE_EVENTS];
+  e->name = name;
+  e->start = start;
+  e->end = trace_start();
+  e->bytes = bytes;
+  e->detail[0] = '\0';
+  if (detail != NULL) strncat(e->detail, detail, TRACE_DETAIL - 1);
+}
+
+void trace_string(FILE* out, const char* s) {
+  fputc('"', out);
+  for (; *s != '\0'; s++) {
+    if (*s == '"' || *s == '\\') fprintf(out, "\\%c", *s);
+    else if ((unsigned char) *s < 0x20) fprintf(out, "\\u%04x", *s);
+    else fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+// Writes the spans of the main thread; registered with atexit() so that failures are traced too.
+void trace_dump() {
+  unsigned long long i = TRACE.next > TRACE_EVENTS ? TRACE.next - TRACE_EVENTS : 0;
+  FILE* out = fopen(TRACE_FILE, "w");
+  if (out == NULL) return;
+  fprintf(out, "{\"traceEvents\":[\n");
+  fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"mywc\"}}", getpid());
+  for (; i < TRACE.next; i++) {
+    struct trace_event* e = &TRACE.events[i % TRACE_EVENTS];
+    fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{", e->name,
+            getpid(), TRACE.tid, e->start / 1e3, (e->end - e->start) / 1e3);
+    fprintf(out, "\"bytes\":%lld", e->bytes);
+    if (e->detail[0] != '\0') {
+      fprintf(out, ",\"file\":");
+      trace_string(out, e->detail);
+    }
+    fprintf(out, "}}");
+  }
+  fprintf(out, "\n],\"otherData\":{\"dropped\":%llu}}\n", TRACE.next > TRACE_EVENTS ? TRACE.next - TRACE_EVENTS : 0);
+  fclose(out);
+}
+
+/*
+ * Content hashes for --hash, computed from the same reads as the counts. XXH3 is the 64-bit variant
+ * with the default secret and seed 0. Its stream keeps up to XXH3_BUFFER bytes back, so that inputs of
+ * up to 240 bytes can be hashed by the short-input functions at the end and the last stripe of a long
+ * input is always at hand. BLAKE3 hashes 1 KiB chunks into chaining values and merges them up a
+ * binary tree with a stack holding one value per level. Both give the same digests as xxhsum -H3 and
+ * b3sum.
+ */
+#define HASH_XXH3 1
+#define HASH_BLAKE3 2
+
+#define XXH_PRIME32_1 0x9E3779B1ULL
+#define XXH_PRIME32_2 0x85EBCA77ULL
+#define XXH_PRIME32_3 0xC2B2AE3DULL
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+#define XXH_PRIME_MX1 0x165667919E3779F9ULL
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ULL
+#define XXH3_SECRET_SIZE 192
+#define XXH3_STRIPES (XXH3_SECRET_SIZE - 64) / 8
+#define XXH3_BUFFER 256
+
+#define BLAKE3_CHUNK 1024
+#define BLAKE3_CHUNK_START 1
+#define BLAKE3_CHUNK_END 2
+#define BLAKE3_PARENT 4
+#define BLAKE3_ROOT 8
+
+static const unsigned char XXH3_SECRET[XXH3_SECRET_SIZE] = {
+  0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+  0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+  0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+  0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+  0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+  0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+  0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+  0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+  0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+  0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+  0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+  0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static const unsigned int BLAKE3_IV[8] = {
+  0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+static const unsigned char BLAKE3_PERMUTATION[16] = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+struct xxh3 {
+  unsigned long long acc[8];
+  unsigned char buffer[XXH3_BUFFER];
+  size_t buffered;
+  unsigned long long length;
+  int stripes;
+};
+
+struct blake3 {
+  unsigned int cv[8];
+  unsigned int stack[54][8];
+  int depth;
+  unsigned long long chunk;
+  unsigned char block[64];
+  size_t block_length;
+  int blocks;
+};
+
+int HASH = 0;
+struct xxh3 XXH3;
+struct blake3 BLAKE3;
+
+unsigned long long read_le64(const unsigned char* p) {
+  unsigned long long value;
+  memcpy(&value, p, 8);
+  return value;
+}
+
+unsigned int read_le32(const unsigned char* p) {
+  unsigned int value;
+  memcpy(&value, p, 4);
+  return value;
+}
+
+unsigned long long rotl64(unsigned long long x, int r) {
+  return x << r | x >> (64 - r);
+}
+
+unsigned long long mul128_fold64(unsigned long long a, unsigned long long b) {
+  unsigned __int128 product = (unsigned __int128) a * b;
+  return (unsigned long long) product ^ (unsigned long long) (product >> 64);
+}
+
+unsigned long long xxh64_avalanche(unsigned long long h) {
+  h ^= h >> 33;
+  h *= XXH_PRIME64_2;
+  h ^= h >> 29;
+  h *= XXH_PRIME64_3;
+  return h ^ h >> 32;
+}
+
+unsigned long long xxh3_avalanche(unsigned long long h) {
+  h ^= h >> 37;
+  h *= XXH_PRIME_MX1;
+  return h ^ h >> 32;
+}
+
+unsigned long long xxh3_mix16(const unsigned char* p, const unsigned char* secret) {
+  return mul128_fold64(read_le64(p) ^ read_le64(secret), read_le64(p + 8) ^ read_le64(secret + 8));
+}
+
+// The one-shot hash of inputs of at most 240 bytes.
+unsigned long long xxh3_short(const unsigned char* p, size_t n) {
+  const unsigned char* s = XXH3_SECRET;
+  unsigned long long acc = n * XXH_PRIME64_1;
+  size_t i;
+  if (n == 0) return xxh64_avalanche(read_le64(s + 56) ^ read_le64(s + 64));
+  if (n <= 3) {
+    unsigned int combined = (unsigned int) p[0] << 16 | (unsigned int) p[n >> 1] << 24 | p[n - 1] | n << 8;
+    return xxh64_avalanche(combined ^ (unsigned long long) (read_le32(s) ^ read_le32(s + 4)));
+  }
+  if (n <= 8) {
+    unsigned long long h = (read_le32(p + n - 4) + ((unsigned long long) read_le32(p) << 32)) ^
+                           (read_le64(s + 8) ^ read_le64(s + 16));
+    h ^= rotl64(h, 49) ^ rotl64(h, 24);
+    h *= XXH_PRIME_MX2;
+    h ^= (h >> 35) + n;
+    h *= XXH_PRIME_MX2;
+    return h ^ h >> 28;
+  }
+  if (n <= 16) {
+    unsigned long long low = read_le64(p) ^ (read_le64(s + 24) ^ read_le64(s + 32));
+    unsigned long long high = read_le64(p + n - 8) ^ (read_le64(s + 40) ^ read_le64(s + 48));
+    return xxh3_avalanche(n + __builtin_bswap64(low) + high + mul128_fold64(low, high));
+  }
+  if (n <= 128) {
+    if (n > 32) {
+      if (n > 64) {
+        if (n > 96) acc += xxh3_mix16(p + 48, s + 96) + xxh3_mix16(p + n - 64, s + 112);
+        acc += xxh3_mix16(p + 32, s + 64) + xxh3_mix16(p + n - 48, s + 80);
+      }
+      acc += xxh3_mix16(p + 16, s + 32) + xxh3_mix16(p + n - 32, s + 48);
+    }
+    acc += xxh3_mix16(p, s) + xxh3_mix16(p + n - 16, s + 16);
+    return xxh3_avalanche(acc);
+  }
+  for (i = 0; i < 8; i++) acc += xxh3_mix16(p + 16 * i, s + 16 * i);
+  acc = xxh3_avalanche(acc);
+  for (i = 8; i < n / 16; i++) acc += xxh3_mix16(p + 16 * i, s + 16 * (i - 8) + 3);
+  acc += xxh3_mix16(p + n - 16, s + 136 - 17);
+  return xxh3_avalanche(acc);
+}
+
+void xxh3_stripe(unsigned long long* acc, const unsigned char* p, const unsigned char* secret) {
+  int i;
+  for (i = 0; i < 8; i++) {
+    unsigned long long value = read_le64(p + 8 * i);
+    unsigned long long key = value ^ read_le64(secret + 8 * i);
+    acc[i ^ 1] += value;
+    acc[i] += (key & 0xffffffff) * (key >> 32);
+  }
+}
+
+void xxh3_scramble(unsigned long long* acc) {
+  int i;
+  for (i = 0; i < 8; i++) {
+    unsigned long long a = acc[i];
+    a ^= a >> 47;
+    a ^= read_le64(XXH3_SECRET + XXH3_SECRET_SIZE - 64 + 8 * i);
+    acc[i] = a * XXH_PRIME32_1;
+  }
+}
+
+// Accumulates whole stripes, scrambling the accumulators at the end of every block.
+void xxh3_stripes(unsigned long long* acc, int* done, const unsigned char* p, size_t stripes) {
+  size_t i;
+  for (i = 0; i < stripes; i++) {
+    xxh3_stripe(acc, p + 64 * i, XXH3_SECRET + 8 * *done);
+    if (++*done == XXH3_STRIPES) {
+      xxh3_scramble(acc);
+      *done = 0;
+    }
+  }
+}
+
+void xxh3_init(struct xxh3* h) {
+  static const unsigned long long acc[8] = {XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3,
+                                            XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1};
+  memcpy(h->acc, acc, sizeof(acc));
+  h->buffered = 0;
+  h->length = 0;
+  h->stripes = 0;
+}
+
+// Appends to the buffer while it has room; a full buffer is consumed only once more input arrives.
+void xxh3_update(struct xxh3* h, const unsigned char* p, size_t n) {
+  const unsigned char* start = p;
+  h->length += n;
+  if (h->buffered + n <= XXH3_BUFFER) {
+    memcpy(h->buffer + h->buffered, p, n);
+    h->buffered += n;
+    return;
+  }
+  if (h->buffered > 0) {
+    size_t fill = XXH3_BUFFER - h->buffered;
+    memcpy(h->buffer + h->buffered, p, fill);
+    p += fill;
+    n -= fill;
+    xxh3_stripes(h->acc, &h->stripes, h->buffer, XXH3_BUFFER / 64);
+  }
+  while (n > XXH3_BUFFER) {
+    xxh3_stripes(h->acc, &h->stripes, p, XXH3_BUFFER / 64);
+    p += XXH3_BUFFER;
+    n -= XXH3_BUFFER;
+  }
+  // The digest needs the stripe before a remainder shorter than a stripe. It is at the end of the
+  // buffer already when the buffer was the last to be consumed.
+  if (p - start >= 64) memcpy(h->buffer + XXH3_BUFFER - 64, p - 64, 64);
+  memcpy(h->buffer, p, n);
+  h->buffered = n;
+}
+
+unsigned long long xxh3_digest(struct xxh3* h) {
+  unsigned long long acc[8], result = h->length * XXH_PRIME64_1;
+  unsigned char last[64];
+  int stripes = h->stripes, i;
+  if (h->length <= 240) return xxh3_short(h->buffer, h->length);
+  memcpy(acc, h->acc, sizeof(acc));
+  if (h->buffered >= 64) {
+    xxh3_stripes(acc, &stripes, h->buffer, (h->buffered - 1) / 64);
+    memcpy(last, h->buffer + h->buffered - 64, 64);
+  } else {
+    memcpy(last, h->buffer + XXH3_BUFFER - (64 - h->buffered), 64 - h->buffered);
+    memcpy(last + 64 - h->buffered, h->buffer, h->buffered);
+  }
+  xxh3_stripe(acc, last, XXH3_SECRET + XXH3_SECRET_SIZE - 64 - 7);
+  for (i = 0; i < 4; i++) {
+    const unsigned char* s = XXH3_SECRET + 11 + 16 * i;
+    result += mul128_fold64(acc[2 * i] ^ read_le64(s), acc[2 * i + 1] ^ read_le64(s + 8));
+  }
+  return xxh3_avalanche(result);
+}
+
+unsigned int rotr32(unsigned int x, int r) {
+  return x >> r | x << (32 - r);
+}
+
+void blake3_g(unsigned int* v, int a, int b, int c, int d, unsigned int x, unsigned int y) {
+  v[a] += v[b] + x;
+  v[d] = rotr32(v[d] ^ v[a], 16);
+  v[c] += v[d];
+  v[b] = rotr32(v[b] ^ v[c], 12);
+  v[a] += v[b] + y;
+  v[d] = rotr32(v[d] ^ v[a], 8);
+  v[c] += v[d];
+  v[b] = rotr32(v[b] ^ v[c], 7);
+}
+
+// Compresses a 64-byte block into the chaining value `out'.
+void blake3_compress(const unsigned int* cv, const unsigned char* block, unsigned long long counter,
+                     int length, int flags, unsigned int* out) {
+  unsigned int v[16], m[16], permuted[16];
+  int round, i;
+  for (i = 0; i < 16; i++) m[i] = read_le32(block + 4 * i);
+  memcpy(v, cv, 32);
+  memcpy(v + 8, BLAKE3_IV, 16);
+  v[12] = (unsigned int) counter;
+  v[13] = (unsigned int) (counter >> 32);
+  v[14] = length;
+  v[15] = flags;
+  for (round = 0; round < 7; round++) {
+    blake3_g(v, 0, 4, 8, 12, m[0], m[1]);
+    blake3_g(v, 1, 5, 9, 13, m[2], m[3]);
+    blake3_g(v, 2, 6, 10, 14, m[4], m[5]);
+    blake3_g(v, 3, 7, 11, 15, m[6], m[7]);
+    blake3_g(v, 0, 5, 10, 15, m[8], m[9]);
+    blake3_g(v, 1, 6, 11, 12, m[10], m[11]);
+    blake3_g(v, 2, 7, 8, 13, m[12], m[13]);
+    blake3_g(v, 3, 4, 9, 14, m[14], m[15]);
+    for (i = 0; i < 16; i++) permuted[i] = m[BLAKE3_PERMUTATION[i]];
+    memcpy(m, permuted, sizeof(m));
+  }
+  for (i = 0; i < 8; i++) out[i] = v[i] ^ v[i + 8];
+}
+
+void blake3_parent(const unsigned int* left, const unsigned int* right, int flags, unsigned int* out) {
+  unsigned char block[64];
+  memcpy(block, left, 32);
+  memcpy(block + 32, right, 32);
+  blake3_compress(BLAKE3_IV, block, 0, 64, BLAKE3_PARENT | flags, out);
+}
+
+void blake3_init(struct blake3* h) {
+  memcpy(h->cv, BLAKE3_IV, 32);
+  h->depth = 0;
+  h->chunk = 0;
+  h->block_length = 0;
+  h->blocks = 0;
+}
+
+// Compresses the buffered block, which is not the last of its chunk, into the chunk's chaining value.
+void blake3_block(struct blake3* h) {
+  blake3_compress(h->cv, h->block, h->chunk, 64, h->blocks == 0 ? BLAKE3_CHUNK_START : 0, h->cv);
+  h->blocks++;
+  h->block_length = 0;
+}
+
+// Pushes the value of a finished chunk and merges the subtrees it completes: after chunk n there is
+// one value on the stack for every bit set in n.
+void blake3_push(struct blake3* h, unsigned int* cv) {
+  unsigned long long chunks = h->chunk + 1;
+  while ((chunks & 1) == 0) {
+    blake3_parent(h->stack[--h->depth], cv, 0, cv);
+    chunks >>= 1;
+  }
+  memcpy(h->stack[h->depth++], cv, 32);
+}
+
+// A full block is compressed only once more input arrives, since the last block of the input is
+// compressed with the root flag instead.
+void blake3_update(struct blake3* h, const unsigned char* p, size_t n) {
+  while (n > 0) {
+    if (h->block_length == 64) {
+      if (h->blocks == BLAKE3_CHUNK / 64 - 1) {
+        unsigned int cv[8];
+        blake3_compress(h->cv, h->block, h->chunk, 64, BLAKE3_CHUNK_END, cv);
+        blake3_push(h, cv);
+        memcpy(h->cv, BLAKE3_IV, 32);
+        h->chunk++;
+        h->blocks = 0;
+        h->block_length = 0;
+      } else {
+        blake3_block(h);
+      }
+    }
+    size_t take = 64 - h->block_length < n ? 64 - h->block_length : n;
+    memcpy(h->block + h->block_length, p, take);
+    h->block_length += take;
+    p += take;
+    n -= take;
+  }
+}
+
+void blake3_digest(struct blake3* h, unsigned int* out) {
+  int flags = BLAKE3_CHUNK_END | (h->blocks == 0 ? BLAKE3_CHUNK_START : 0);
+  int depth = h->depth;
+  memset(h->block + h->block_length, 0, 64 - h->block_length);
+  if (depth == 0) {
+    blake3_compress(h->cv, h->block, h->chunk, h->block_length, flags | BLAKE3_ROOT, out);
+    return;
+  }
+  blake3_compress(h->cv, h->block, h->chunk, h->block_length, flags, out);
+  while (depth > 1) blake3_parent(h->stack[--depth], out, 0, out);
+  blake3_parent(h->stack[0], out, BLAKE3_ROOT, out);
+}
+
+void hash_init() {
+  if (HASH == HASH_XXH3) xxh3_init(&XXH3);
+  if (HASH == HASH_BLAKE3) blake3_init(&BLAKE3);
+}
+
+void hash_update(const unsigned char* p, size_t n) {
+  if (HASH == HASH_XXH3) xxh3_update(&XXH3, p, n);
+  if (HASH == HASH_BLAKE3) blake3_update(&BLAKE3, p, n);
+}
+
+// Writes the digest of the current file as a column after the counts.
+void print_hash() {
+  int i;
+  if (HASH == HASH_XXH3) printf(" %016llx", xxh3_digest(&XXH3));
+  if (HASH == HASH_BLAKE3) {
+    unsigned int digest[8];
+    blake3_digest(&BLAKE3, digest);
+    printf(" ");
+    for (i = 0; i < 32; i++) printf("%02x", digest[i / 4] >> 8 * (i % 4) & 0xff);
+  }
+}
+
+/*
+ * The reader for --io-limit, --ionice, --hash and --trace. Input files are opened with open_input(),
+ * which returns a plain stdio stream, or one whose reads go through io_read() when the I/O rate is
+ * limited, the file is hashed, the reads are traced or the bytes read are also given to the masks of
+ * --boundaries, --per-line, --graphemes and --max-width. io_read() takes tokens from a bucket that
+ * fills at IO_LIMIT bytes per second, and waits for the tokens before it issues the read, so the
+ * rate stays smooth instead of bursting and sleeping afterwards. The bucket holds at most a tenth of
+ * a second of tokens. Tokens of a read that returned less than it asked for are given back.
+ */
+#define IO_BUFFER 65536
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
+double IO_LIMIT = 0;
+int INPUT_BUFFER = 0;
+double IO_TOKENS = 0;
+struct timespec IO_REFILLED;
+int IO_PRIORITY = -1;
+
+struct masks;
+
+void masks_update(struct masks* m, const unsigned char* p, size_t n);
+
+struct input {
+  int fd;
+  bool hashed;
+  struct masks* masks;
+  off_t position;
+  off_t hashed_to;
+  char buffer[];
+};
+
+double seconds_since(struct timespec* then) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - then->tv_sec) + (now.tv_nsec - then->tv_nsec) / 1e9;
+}
+
+void io_refill() {
+  double burst = IO_LIMIT / 10 > IO_BUFFER ? IO_LIMIT / 10 : IO_BUFFER;
+  IO_TOKENS += seconds_since(&IO_REFILLED) * IO_LIMIT;
+  if (IO_TOKENS > burst) IO_TOKENS = burst;
+  clock_gettime(CLOCK_MONOTONIC, &IO_REFILLED);
+}
+
+// Takes `bytes' tokens, waiting until the bucket has them. A debt left by the io_uring engine is paid first.
+void io_throttle(double bytes) {
+  io_refill();
+  if (IO_TOKENS < bytes) {
+    double wait = (bytes - IO_TOKENS) / IO_LIMIT;
+    struct timespec delay = {(time_t) wait, (long) ((wait - (time_t) wait) * 1e9)};
+    nanosleep(&delay, NULL);
+    io_refill();
+  }
+  IO_TOKENS -= bytes;
+}
+
+ssize_t io_read(void* cookie, char* buffer, size_t size) {
+  struct input* input = cookie;
+  if (IO_LIMIT > 0) io_throttle(size);
+  long long start = trace_start();
+  long long probe = PROBE_ENABLED(chunk_end) ? now_ns() : 0;
+  if (PROBE_ENABLED(chunk_start)) PROBE1(chunk_start, size);
+  ssize_t n = read(input->fd, buffer, size);
+  if (PROBE_ENABLED(chunk_end)) PROBE2(chunk_end, n, now_ns() - probe);
+  trace_span("read", start, NULL, n);
+  if (IO_LIMIT > 0) IO_TOKENS += size - (n > 0 ? n : 0);
+  if (input->hashed && n > 0 && input->position + n > input->hashed_to) {
+    off_t skip = input->hashed_to - input->position;
+    hash_update((unsigned char*) buffer + skip, n - skip);
+    input->hashed_to = input->position + n;
+  }
+  if (input->masks != NULL && n > 0) masks_update(input->masks, (unsigned char*) buffer, n);
+  if (n > 0) input->position += n;
+  return n;
+}
+
+int io_close(void* cookie) {
+  struct input* input = cookie;
+  int result = close(input->fd);
+  free(input);
+  return result;
+}
+
+int io_seek(void* cookie, off64_t* offset, int whence) {
+  struct input* input = cookie;
+  off_t position = lseek(input->fd, *offset, whence);
+  if (position < 0) return -1;
+  *offset = input->position = position;
+  return 0;
+}
+
+// Opens an input file. When `hashed' is set, the bytes read are also given to hash_update(), each
+// only once even when the stream is rewound, and unless `masks' is NULL they are given to
+// masks_update(), which expects them read once from the start.
+FILE* open_input(const char* filename, bool hashed, struct masks* masks) {
+  if (IO_LIMIT <= 0 && !hashed && TRACE_FILE == NULL && masks == NULL) {
+    FILE* file = fopen(filename, "rb");
+    if (file != NULL && INPUT_BUFFER > 0) setvbuf(file, NULL, _IOFBF, INPUT_BUFFER);
+    return file;
+  }
+  cookie_io_functions_t functions = {io_read, NULL, io_seek, io_close};
+  size_t size = INPUT_BUFFER > 0 ? INPUT_BUFFER : IO_BUFFER;
+  struct input* input = calloc(1, sizeof(struct input) + size);
+  if (input == NULL) exit(EXIT_FAILURE);
+  input->hashed = hashed;
+  input->masks = masks;
+  long long start = trace_start();
+  input->fd = open(filename, O_RDONLY);
+  trace_span("open", start, filename, 0);
+  if (input->fd < 0) {
+    free(input);
+    return NULL;
+  }
+  FILE* file = fopencookie(input, "rb", functions);
+  if (file == NULL) {
+    close(input->fd);
+    free(input);
+    return NULL;
+  }
+  // A cookie stream ignores the size given to setvbuf() without a buffer, and reads 8 KiB at a time.
+  setvbuf(file, input->buffer, _IOFBF, size);
+  // Cookie streams are locked on every fgetc() otherwise, which makes them several times slower.
+  __fsetlocking(file, FSETLOCKING_BYCALLER);
+  return file;
+}
+
+// Sets the I/O priority of the process from `class' or `class:level', where the class is realtime,
+// best-effort or idle, or its number 1 to 3.
+void set_io_priority(char* priority) {
+  static const char* classes[] = {"none", "realtime", "best-effort", "idle"};
+  int class = -1, level = 4, i;
+  char* colon = strchr(priority, ':');
+  for (i = 1; i < 4; i++) {
+    if (strncmp(priority, classes[i], colon ? (size_t) (colon - priority) : strlen(priority) + 1) == 0 &&
+        strlen(classes[i]) == (colon ? (size_t) (colon - priority) : strlen(priority)))
+      class = i;
+  }
+  if (class < 0) class = atoi(priority);
+  if (colon != NULL) level = atoi(colon + 1);
+  if (class < 1 || class > 3 || level < 0 || level > 7) exit(EXIT_FAILURE);
+  IO_PRIORITY = class << IOPRIO_CLASS_SHIFT | (class == 3 ? 0 : level);
+  if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IO_PRIORITY) != 0) exit(EXIT_FAILURE);
+}
+
+/*
+ * Line endings for --eol. Every <newline> is a LF, unless a <carriage-return> comes right before it,
+ * which makes the pair a CRLF, and every other <carriage-return> is a lone CR. wc() tallies all three
+ * as it reads each byte, and EOL chooses which of them end a line. With EOL_ANY a CRLF ends a line at
+ * its <carriage-return>, and the <newline> is then counted as part of that line.
+ */
+#define EOL_LF 1
+#define EOL_CRLF 2
+#define EOL_CR 3
+#define EOL_ANY 4
+
+int EOL = 0;
+int FILE_EOLS[EOL_CR + 1];
+int TOTAL_EOLS[EOL_CR + 1];
+
+/*
+ * UTF-16 input. A file starting with a byte order mark is counted in 16-bit code units, without
+ * transcoding: lines end at U+000A, and words are split at the code units U+0009 to U+000D and
+ * U+0020. A surrogate pair never contains one of those, so characters outside the BMP are always part
+ * of a word and need no decoding. Each buffer is first classified into a flag per code unit, a loop
+ * the compiler vectorizes, and word starts are then counted from the flags.
+ */
+#define UTF16_LE 1
+#define UTF16_BE 2
+#define UTF16_BUFFER 65536
+
+// Returns the byte order given by the mark at the start of the file, or 0 when there is none, and
+// puts back what it read. The bytes are pushed back rather than rewound, so that pipes keep them;
+// glibc takes back both bytes of a mark, or of a first byte that only looks like one.
+int utf16_bom(FILE* file) {
+  int first = fgetc(file);
+  if (first != 0xff && first != 0xfe) {
+    ungetc(first, file);
+    return 0;
+  }
+  int second = fgetc(file);
+  ungetc(second, file);
+  ungetc(first, file);
+  if (first == 0xff && second == 0xfe) return UTF16_LE;
+  if (first == 0xfe && second == 0xff) return UTF16_BE;
+  return 0;
+}
+
+void wc_utf16(FILE* file, bool big_endian, int* lines, int* words, int* chars) {
+  static unsigned char buffer[UTF16_BUFFER];
+  static unsigned char space[UTF16_BUFFER / 2];
+  int high = big_endian ? 0 : 1;
+  size_t pending = 0;
+  size_t n;
+  bool in_word = false;
+  // The byte order mark.
+  fgetc(file);
+  fgetc(file);
+  *chars += 2;
+  while ((n = fread(buffer + pending, 1, UTF16_BUFFER - pending, file)) > 0) {
+    size_t units, i;
+    int newlines = 0;
+    int starts = 0;
+    *chars += n;
+    n += pending;
+    units = n / 2;
+    for (i = 0; i < units; i++) {
+      unsigned int u = buffer[2 * i + high] << 8 | buffer[2 * i + 1 - high];
+      newlines += u == 0x0a;
+      space[i] = (u >= 0x09 && u <= 0x0d) || u == 0x20;
+    }
+    if (units > 0) {
+      starts = !space[0] && !in_word;
+      for (i = 1; i < units; i++) starts += space[i - 1] & !space[i];
+      in_word = !space[units - 1];
+    }
+    *lines += newlines;
+    *words += starts;
+    pending = n & 1;
+    if (pending) buffer[0] = buffer[n - 1];
+  }
+}
+
+/*
+ * Words per line for --per-line. The counts are taken from the masks of masks_block(): the word starts
+ * before each newline bit of a block belong to the line it ends. PER_LINE_COUNTS writes every line's
+ * count, PER_LINE_HISTOGRAM counts the lines by their number of words, and PER_LINE_EXPECT writes
+ * only the lines whose count is not PER_LINE_FIELDS, with their line number. Lines are written into
+ * PER_LINE_OUT, formatted by hand, and the buffer goes to standard output when it is full and before
+ * the counts of the file.
+ */
+#define PER_LINE_COUNTS 1
+#define PER_LINE_HISTOGRAM 2
+#define PER_LINE_EXPECT 3
+#define PER_LINE_BUFFER 65536
+
+struct histogram {
+  int* lines;
+  int capacity;
+};
+
+int PER_LINE = 0;
+int PER_LINE_FIELDS = 0;
+int PER_LINE_NUMBER = 0;
+char PER_LINE_OUT[PER_LINE_BUFFER];
+size_t PER_LINE_USED = 0;
+struct histogram FILE_HISTOGRAM;
+struct histogram TOTAL_HISTOGRAM;
+
+void per_line_flush() {
+  if (PROBE_ENABLED(output_flush)) PROBE1(output_flush, PER_LINE_USED);
+  fwrite(PER_LINE_OUT, 1, PER_LINE_USED, stdout);
+  PER_LINE_USED = 0;
+}
+
+void per_line_number(int n, char end) {
+  char digits[12];
+  int length = 0;
+  if (PER_LINE_USED > PER_LINE_BUFFER - sizeof(digits)) per_line_flush();
+  do {
+    digits[length++] = '0' + n % 10;
+    n /= 10;
+  } while (n > 0);
+  while (length > 0) PER_LINE_OUT[PER_LINE_USED++] = digits[--length];
+  PER_LINE_OUT[PER_LINE_USED++] = end;
+}
+
+void histogram_add(struct histogram* h, int words, int lines) {
+  if (words >= h->capacity) {
+    int capacity = h->capacity == 0 ? 64 : h->capacity;
+    while (capacity <= words) capacity *= 2;
+    h->lines = realloc(h->lines, capacity * sizeof(int));
+    if (h->lines == NULL) exit(EXIT_FAILURE);
+    memset(h->lines + h->capacity, 0, (capacity - h->capacity) * sizeof(int));
+    h->capacity = capacity;
+  }
+  h->lines[words] += lines;
+}
+
+// Takes the word count of the next line of the file.
+void per_line(int words) {
+  PER_LINE_NUMBER++;
+  if (PER_LINE == PER_LINE_COUNTS) per_line_number(words, '\n');
+  else if (PER_LINE == PER_LINE_HISTOGRAM) histogram_add(&FILE_HISTOGRAM, words, 1);
+  else if (words != PER_LINE_FIELDS) {
+    per_line_number(PER_LINE_NUMBER, ':');
+    per_line_number(words, '\n');
+  }
+}
+
+void report_histogram(struct histogram* h) {
+  int i;
+  for (i = 0; i < h->capacity; i++) {
+    if (h->lines[i] > 0) printf("      %d lines of %d words\n", h->lines[i], i);
+  }
+}
+
+/*
+ * Sentences and paragraphs for --prose. A sentence ends at a word whose last byte, before any closing
+ * quotes or brackets, is a full stop, question mark or exclamation mark, unless the word is one of
+ * PROSE_ABBREVIATIONS or an initial like ``J.'', and also at the end of a paragraph or the file. A
+ * paragraph is a run of lines with text, between blank lines. The bytes are classified by the same
+ * BYTE_CLASS lookup that already splits the words.
+ */
+#define PROSE_WORD 16
+
+struct prose {
+  int sentences;
+  int paragraphs;
+  int words;
+};
+
+static const char* PROSE_ABBREVIATIONS[] = {
+  "mr.", "mrs.", "ms.", "dr.", "prof.", "sr.", "jr.", "st.", "vs.", "etc.", "e.g.", "i.e.", "cf.",
+  "inc.", "ltd.", "co.", "corp.", "no.", "fig.", "eq.", "approx.", "dept.", "est.", "al.", NULL,
+};
+
+bool PROSE = false;
+struct prose FILE_PROSE;
+struct prose TOTAL_PROSE;
+char PROSE_TEXT[PROSE_WORD];
+int PROSE_LENGTH = 0;
+int PROSE_SENTENCE_WORDS = 0;
+bool PROSE_IN_WORD = false;
+bool PROSE_TERMINAL = false;
+bool PROSE_LINE_TEXT = false;
+bool PROSE_IN_PARAGRAPH = false;
+
+bool prose_abbreviation() {
+  size_t length = PROSE_LENGTH;
+  int i;
+  if (length > PROSE_WORD) return false;
+  while (length > 0 && BYTE_CLASS[(unsigned char) PROSE_TEXT[length - 1]] & CLASS_CLOSER) length--;
+  if (length == 2 && BYTE_CLASS[(unsigned char) PROSE_TEXT[0]] & CLASS_UPPER) return true;
+  for (i = 0; PROSE_ABBREVIATIONS[i] != NULL; i++) {
+    if (strlen(PROSE_ABBREVIATIONS[i]) == length && strncasecmp(PROSE_TEXT, PROSE_ABBREVIATIONS[i], length) == 0)
+      return true;
+  }
+  return false;
+}
+
+void prose_sentence_end() {
+  if (PROSE_SENTENCE_WORDS == 0) return;
+  FILE_PROSE.sentences++;
+  FILE_PROSE.words += PROSE_SENTENCE_WORDS;
+  PROSE_SENTENCE_WORDS = 0;
+}
+
+void prose_word_end() {
+  if (PROSE_TERMINAL && !prose_abbreviation()) prose_sentence_end();
+  PROSE_IN_WORD = PROSE_TERMINAL = false;
+}
+
+void prose_byte(int c, int class) {
+  if (class & CLASS_SPACE) {
+    if (PROSE_IN_WORD) prose_word_end();
+    if (class & CLASS_NEWLINE) {
+      if (!PROSE_LINE_TEXT) {
+        prose_sentence_end();
+        PROSE_IN_PARAGRAPH = false;
+      }
+      PROSE_LINE_TEXT = false;
+    }
+    return;
+  }
+  if (!PROSE_IN_WORD) {
+    PROSE_IN_WORD = true;
+    PROSE_LENGTH = 0;
+    PROSE_SENTENCE_WORDS++;
+    if (!PROSE_IN_PARAGRAPH) FILE_PROSE.paragraphs++;
+    PROSE_IN_PARAGRAPH = true;
+  }
+  PROSE_LINE_TEXT = true;
+  if (PROSE_LENGTH < PROSE_WORD) PROSE_TEXT[PROSE_LENGTH] = c;
+  PROSE_LENGTH++;
+  if (class & CLASS_TERMINAL) PROSE_TERMINAL = true;
+  else if (!(class & CLASS_CLOSER)) PROSE_TERMINAL = false;
+}
+
+void prose_start() {
+  memset(&FILE_PROSE, 0, sizeof(FILE_PROSE));
+  PROSE_SENTENCE_WORDS = 0;
+  PROSE_IN_WORD = PROSE_TERMINAL = PROSE_LINE_TEXT = PROSE_IN_PARAGRAPH = false;
+}
+
+void prose_finish() {
+  if (PROSE_IN_WORD) prose_word_end();
+  prose_sentence_end();
+  TOTAL_PROSE.sentences += FILE_PROSE.sentences;
+  TOTAL_PROSE.paragraphs += FILE_PROSE.paragraphs;
+  TOTAL_PROSE.words += FILE_PROSE.words;
+}
+
+void report_prose(struct prose* p) {
+  printf("      %d sentences      %d paragraphs      %.1f words per sentence\n", p->sentences, p->paragraphs,
+         p->sentences > 0 ? (double) p->words / p->sentences : 0.0);
+}
+
+/*
+ * Approximate LLM token counts for --tokens=VOCAB. VOCAB is a byte-pair vocabulary in the tiktoken
+ * format, a base64 token and its rank on each line, and is kept in an open-addressing table keyed by
+ * the token bytes. Every word of wc() is encoded as if a space preceded it, the way byte-pair
+ * vocabularies usually split text, and every newline counts as a token of its own. A word is encoded
+ * by merging, again and again, the adjacent pair of parts whose joined bytes have the lowest rank,
+ * until no joined pair is in the vocabulary. Text repeats its words a lot, so the token counts of
+ * words up to TOKEN_WORD bytes are kept in a direct-mapped cache of TOKEN_CACHE entries. Words longer
+ * than TOKEN_PIECE bytes are encoded in pieces of that size.
+ */
+#define TOKEN_WORD 32
+#define TOKEN_CACHE 65536
+#define TOKEN_PIECE 1024
+
+struct vocab_entry {
+  unsigned int offset;
+  int length;
+  int rank;
+};
+
+struct vocab {
+  struct vocab_entry* slots;
+  int capacity;
+  int size;
+  unsigned char* pool;
+  size_t pool_size;
+  size_t pool_capacity;
+};
+
+struct token_cached {
+  int length;
+  int tokens;
+  unsigned char text[TOKEN_WORD];
+};
+
+bool TOKENS = false;
+struct vocab VOCAB;
+struct token_cached* TOKEN_CACHED;
+unsigned char TOKEN_TEXT[TOKEN_PIECE];
+int TOKEN_LENGTH = 0;
+bool TOKEN_IN_WORD = false;
+int FILE_TOKENS = 0;
+int TOTAL_TOKENS = 0;
+
+unsigned int bytes_hash(const unsigned char* p, int n) {
+  unsigned int h = 2166136261u;
+  int i;
+  for (i = 0; i < n; i++) h = (h ^ p[i]) * 16777619u;
+  return h;
+}
+
+int vocab_rank(const unsigned char* p, int n) {
+  unsigned int i = bytes_hash(p, n) & (VOCAB.capacity - 1);
+  while (VOCAB.slots[i].rank >= 0) {
+    struct vocab_entry* e = &VOCAB.slots[i];
+    if (e->length == n && memcmp(VOCAB.pool + e->offset, p, n) == 0) return e->rank;
+    i = (i + 1) & (VOCAB.capacity - 1);
+  }
+  return -1;
+}
+
+int base64_decode(const char* in, unsigned char* out) {
+  int bits = 0, value = 0, n = 0;
+  for (; *in != '\0' && *in != '='; in++) {
+    const char* digit = strchr("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/", *in);
+    if (digit == NULL) return -1;
+    value = value << 6 | (int) (digit - "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out[n++] = value >> bits & 0xff;
+    }
+  }
+  return n;
+}
+
+void vocab_load(const char* path) {
+  char line[1024];
+  unsigned char token[768];
+  int rank, i;
+  FILE* file = fopen(path, "r");
+  if (file == NULL) exit(EXIT_FAILURE);
+  VOCAB.capacity = 1 << 10;
+  VOCAB.slots = malloc(VOCAB.capacity * sizeof(struct vocab_entry));
+  if (VOCAB.slots == NULL) exit(EXIT_FAILURE);
+  for (i = 0; i < VOCAB.capacity; i++) VOCAB.slots[i].rank = -1;
+  while (fscanf(file, "%1023s %d", line, &rank) == 2) {
+    int n = base64_decode(line, token);
+    if (n <= 0 || rank < 0) exit(EXIT_FAILURE);
+    if (vocab_rank(token, n) >= 0) continue;
+    if (2 * (VOCAB.size + 1) > VOCAB.capacity) {
+      struct vocab_entry* old = VOCAB.slots;
+      int old_capacity = VOCAB.capacity;
+      VOCAB.capacity *= 2;
+      VOCAB.slots = malloc(VOCAB.capacity * sizeof(struct vocab_entry));
+      if (VOCAB.slots == NULL) exit(EXIT_FAILURE);
+      for (i = 0; i < VOCAB.capacity; i++) VOCAB.slots[i].rank = -1;
+      for (i = 0; i < old_capacity; i++) {
+        if (old[i].rank < 0) continue;
+        unsigned int j = bytes_hash(VOCAB.pool + old[i].offset, old[i].length) & (VOCAB.capacity - 1);
+        while (VOCAB.slots[j].rank >= 0) j = (j + 1) & (VOCAB.capacity - 1);
+        VOCAB.slots[j] = old[i];
+      }
+      free(old);
+    }
+    if (VOCAB.pool_size + n > VOCAB.pool_capacity) {
+      VOCAB.pool_capacity = VOCAB.pool_capacity == 0 ? 1 << 16 : 2 * VOCAB.pool_capacity;
+      VOCAB.pool = realloc(VOCAB.pool, VOCAB.pool_capacity);
+      if (VOCAB.pool == NULL) exit(EXIT_FAILURE);
+    }
+    memcpy(VOCAB.pool + VOCAB.pool_size, token, n);
+    unsigned int j = bytes_hash(token, n) & (VOCAB.capacity - 1);
+    while (VOCAB.slots[j].rank >= 0) j = (j + 1) & (VOCAB.capacity - 1);
+    VOCAB.slots[j].offset = VOCAB.pool_size;
+    VOCAB.slots[j].length = n;
+    VOCAB.slots[j].rank = rank;
+    VOCAB.pool_size += n;
+    VOCAB.size++;
+  }
+  fclose(file);
+  TOKEN_CACHED = calloc(TOKEN_CACHE, sizeof(struct token_cached));
+  if (TOKEN_CACHED == NULL) exit(EXIT_FAILURE);
+}
+
+// Returns the number of tokens of the byte-pair encoding of a word. parts[i] is where part i starts,
+// and ranks[i] the rank of part i joined with part i + 1, or -1 when that is not a token.
+int bpe_count(const unsigned char* p, int n) {
+  int parts[TOKEN_PIECE + 1], ranks[TOKEN_PIECE];
+  int count = n, i;
+  if (n <= 1 || vocab_rank(p, n) >= 0) return n > 0 ? 1 : 0;
+  for (i = 0; i <= n; i++) parts[i] = i;
+  for (i = 0; i + 1 < n; i++) ranks[i] = vocab_rank(p + i, 2);
+  while (count > 1) {
+    int best = -1;
+    for (i = 0; i + 1 < count; i++) {
+      if (ranks[i] >= 0 && (best < 0 || ranks[i] < ranks[best])) best = i;
+    }
+    if (best < 0) break;
+    memmove(parts + best + 1, parts + best + 2, (count - best - 1) * sizeof(int));
+    memmove(ranks + best + 1, ranks + best + 2, (count - best - 3 > 0 ? count - best - 3 : 0) * sizeof(int));
+    count--;
+    if (best + 1 < count) ranks[best] = vocab_rank(p + parts[best], parts[best + 2] - parts[best]);
+    else ranks[best] = -1;
+    if (best > 0) ranks[best - 1] = vocab_rank(p + parts[best - 1], parts[best + 1] - parts[best - 1]);
+  }
+  return count;
+}
+
+void tokens_word() {
+  int n = TOKEN_LENGTH;
+  TOKEN_LENGTH = 0;
+  if (n > TOKEN_WORD) {
+    FILE_TOKENS += bpe_count(TOKEN_TEXT, n);
+    return;
+  }
+  struct token_cached* cached = &TOKEN_CACHED[bytes_hash(TOKEN_TEXT, n) & (TOKEN_CACHE - 1)];
+  if (cached->length != n || memcmp(cached->text, TOKEN_TEXT, n) != 0) {
+    if (PROBE_ENABLED(cache_miss)) PROBE2(cache_miss, "tokens", n);
+    cached->length = n;
+    memcpy(cached->text, TOKEN_TEXT, n);
+    cached->tokens = bpe_count(TOKEN_TEXT, n);
+  } else if (PROBE_ENABLED(cache_hit)) {
+    PROBE2(cache_hit, "tokens", n);
+  }
+  FILE_TOKENS += cached->tokens;
+}
+
+void tokens_byte(int c, int class) {
+  if (class & CLASS_SPACE) {
+    if (TOKEN_IN_WORD) tokens_word();
+    if (class & CLASS_NEWLINE) FILE_TOKENS++;
+    TOKEN_IN_WORD = false;
+    return;
+  }
+  if (!TOKEN_IN_WORD) TOKEN_TEXT[TOKEN_LENGTH++] = ' ';
+  else if (TOKEN_LENGTH == TOKEN_PIECE) tokens_word();
+  TOKEN_IN_WORD = true;
+  TOKEN_TEXT[TOKEN_LENGTH++] = c;
+}
+
+void tokens_finish() {
+  if (TOKEN_IN_WORD) tokens_word();
+  TOKEN_IN_WORD = false;
+  TOTAL_TOKENS += FILE_TOKENS;
+}
+
+/*
+ * C and C++ token counts for --code-stats. The lexer of exclude_comments() only knows ``//''; this one
+ * takes a byte at a time from the wc() loop and keeps the kind of the token it is in, so it needs no
+ * second pass. Identifiers are looked up in KEYWORDS, a perfect hash table of the C11 and C++20
+ * keywords, with asm and the alternative tokens of C++ such as and, bitor and not_eq, which are
+ * keywords there and macros of <iso646.h> in C: the multipliers of keyword_hash() were found by search
+ * so that no two keywords share a slot, and a lookup is one hash and one string compare. Operators are
+ * split by maximal munch against CODE_OPERATORS. A ``#'' that starts a line counts as a directive and
+ * not as an operator. String and character literals may have an L, u, U or u8 prefix; raw strings are
+ * not recognized.
+ */
+#define CODE_NONE 0
+#define CODE_IDENTIFIER 1
+#define CODE_NUMBER 2
+#define CODE_STRING 3
+#define CODE_STRING_ESCAPE 4
+#define CODE_CHAR 5
+#define CODE_CHAR_ESCAPE 6
+#define CODE_OPERATOR 7
+#define CODE_LINE_COMMENT 8
+#define CODE_BLOCK_COMMENT 9
+#define CODE_BLOCK_STAR 10
+#define CODE_WORD 17
+#define KEYWORD_SLOTS 512
+
+struct code_stats {
+  int keywords;
+  int identifiers;
+  int literals;
+  int operators;
+  int comments;
+  int directives;
+};
+
+static const char* KEYWORDS[KEYWORD_SLOTS] = {
+  [4] = "concept", [11] = "this", [13] = "catch", [16] = "if", [26] = "do", [34] = "and", [44] = "mutable",
+  [49] = "thread_local", [55] = "constinit", [66] = "namespace", [77] = "or_eq", [83] = "decltype",
+  [88] = "co_yield", [104] = "new", [106] = "co_await", [107] = "short", [117] = "const", [131] = "union",
+  [135] = "double", [137] = "volatile", [138] = "_Thread_local", [149] = "char32_t", [152] = "static",
+  [154] = "_Atomic", [157] = "_Complex", [159] = "constexpr", [160] = "case", [170] = "not_eq",
+  [176] = "default", [183] = "extern", [184] = "xor", [187] = "alignof", [188] = "throw", [190] = "noexcept",
+  [191] = "static_assert", [192] = "_Alignof", [201] = "class", [211] = "auto", [218] = "return",
+  [223] = "break", [224] = "register", [226] = "int", [237] = "nullptr", [238] = "_Imaginary",
+  [241] = "switch", [242] = "wchar_t", [243] = "struct", [245] = "else", [247] = "char16_t",
+  [250] = "_Static_assert", [267] = "and_eq", [278] = "try", [279] = "alignas", [281] = "goto",
+  [284] = "_Alignas", [292] = "continue", [295] = "operator", [297] = "virtual", [298] = "bool",
+  [303] = "explicit", [304] = "typedef", [305] = "enum", [306] = "bitand", [307] = "protected",
+  [309] = "signed", [326] = "compl", [327] = "char", [330] = "private", [332] = "char8_t",
+  [334] = "co_return", [335] = "_Noreturn", [336] = "not", [350] = "typeid", [351] = "long", [359] = "float",
+  [369] = "_Bool", [374] = "const_cast", [376] = "_Generic", [377] = "reinterpret_cast", [381] = "bitor",
+  [389] = "friend", [390] = "sizeof", [391] = "static_cast", [394] = "using", [401] = "inline",
+  [405] = "export", [406] = "requires", [411] = "unsigned", [413] = "while", [425] = "restrict",
+  [426] = "xor_eq", [433] = "false", [440] = "for", [446] = "delete", [447] = "public", [456] = "or",
+  [461] = "true", [471] = "consteval", [475] = "template", [476] = "dynamic_cast", [485] = "typename",
+  [496] = "void", [500] = "asm",
+};
+
+static const char* CODE_OPERATORS[] = {
+  "[", "]", "(", ")", "{", "}", ".", "->", "++", "--", "&", "*", "+", "-", "~", "!", "/", "%", "<<", ">>",
+  "<", ">", "<=", ">=", "==", "!=", "^", "|", "&&", "||", "?", ":", ";", "...", "=", "*=", "/=", "%=",
+  "+=", "-=", "<<=", ">>=", "&=", "^=", "|=", ",", "#", "##", "::", ".*", "->*", "<=>", NULL,
+};
+
+bool CODE_STATS = false;
+struct code_stats FILE_CODE;
+struct code_stats TOTAL_CODE;
+int CODE_STATE = CODE_NONE;
+char CODE_TEXT[CODE_WORD + 1];
+int CODE_LENGTH = 0;
+bool CODE_LINE_START = true;
+
+unsigned int keyword_hash(const char* w, int n) {
+  return (384 * (unsigned char) w[0] + 31 * (unsigned char) w[1] + 204 * (unsigned char) w[n - 1] + 58 * n +
+          207 * (unsigned char) w[n / 2]) % KEYWORD_SLOTS;
+}
+
+bool keyword(const char* w, int n) {
+  if (n < 2 || n >= CODE_WORD) return false;
+  const char* k = KEYWORDS[keyword_hash(w, n)];
+  return k != NULL && strncmp(k, w, n) == 0 && k[n] == '\0';
+}
+
+// Returns whether `text' is the start of an operator.
+bool operator_prefix(const char* text, int n) {
+  int i;
+  for (i = 0; CODE_OPERATORS[i] != NULL; i++) {
+    if (strncmp(CODE_OPERATORS[i], text, n) == 0) return true;
+  }
+  return false;
+}
+
+bool identifier_byte(int c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+// Ends the identifier, number or operator being read.
+void code_token_end() {
+  if (CODE_STATE == CODE_IDENTIFIER) {
+    if (keyword(CODE_TEXT, CODE_LENGTH)) FILE_CODE.keywords++;
+    else FILE_CODE.identifiers++;
+  } else if (CODE_STATE == CODE_NUMBER) {
+    FILE_CODE.literals++;
+  } else if (CODE_STATE == CODE_OPERATOR) {
+    FILE_CODE.operators++;
+  }
+  CODE_STATE = CODE_NONE;
+}
+
+void code_byte(int c) {
+  switch (CODE_STATE) {
+  case CODE_IDENTIFIER:
+    if (identifier_byte(c)) {
+      if (CODE_LENGTH < CODE_WORD) CODE_TEXT[CODE_LENGTH] = c;
+      CODE_LENGTH++;
+      return;
+    }
+    if ((c == '"' || c == '\'') && CODE_LENGTH <= 2 && (strncmp(CODE_TEXT, "L", CODE_LENGTH) == 0 ||
+        strncmp(CODE_TEXT, "u", CODE_LENGTH) == 0 || strncmp(CODE_TEXT, "U", CODE_LENGTH) == 0 ||
+        strncmp(CODE_TEXT, "u8", CODE_LENGTH) == 0)) {
+      CODE_STATE = c == '"' ? CODE_STRING : CODE_CHAR;
+      return;
+    }
+    code_token_end();
+    break;
+  case CODE_NUMBER: {
+    char last = CODE_TEXT[0];
+    CODE_TEXT[0] = c;
+    if (identifier_byte(c) || c == '.' || c == '\'' ||
+        ((c == '+' || c == '-') && (last == 'e' || last == 'E' || last == 'p' || last == 'P')))
+      return;
+    code_token_end();
+    break;
+  }
+  case CODE_STRING:
+  case CODE_CHAR:
+    if (c == '\\') {
+      CODE_STATE++;
+    } else if (c == (CODE_STATE == CODE_STRING ? '"' : '\'') || c == '\n') {
+      FILE_CODE.literals++;
+      CODE_STATE = CODE_NONE;
+      CODE_LINE_START = c == '\n';
+    }
+    return;
+  case CODE_STRING_ESCAPE:
+  case CODE_CHAR_ESCAPE:
+    CODE_STATE--;
+    return;
+  case CODE_LINE_COMMENT:
+    if (c == '\n') {
+      CODE_STATE = CODE_NONE;
+      CODE_LINE_START = true;
+    }
+    return;
+  case CODE_BLOCK_COMMENT:
+    if (c == '*') CODE_STATE = CODE_BLOCK_STAR;
+    return;
+  case CODE_BLOCK_STAR:
+    if (c == '/') CODE_STATE = CODE_NONE;
+    else if (c != '*') CODE_STATE = CODE_BLOCK_COMMENT;
+    return;
+  case CODE_OPERATOR:
+    if (CODE_LENGTH == 1 && CODE_TEXT[0] == '/' && (c == '/' || c == '*')) {
+      FILE_CODE.comments++;
+      CODE_STATE = c == '/' ? CODE_LINE_COMMENT : CODE_BLOCK_COMMENT;
+      return;
+    }
+    if (CODE_LENGTH == 1 && CODE_TEXT[0] == '.' && c >= '0' && c <= '9') {
+      CODE_STATE = CODE_NUMBER;
+      CODE_TEXT[0] = c;
+      return;
+    }
+    CODE_TEXT[CODE_LENGTH] = c;
+    if (CODE_LENGTH < 3 && operator_prefix(CODE_TEXT, CODE_LENGTH + 1)) {
+      CODE_LENGTH++;
+      return;
+    }
+    code_token_end();
+    break;
+  }
+  if (wspace(c)) {
+    if (c == '\n') CODE_LINE_START = true;
+    return;
+  }
+  CODE_TEXT[0] = c;
+  CODE_LENGTH = 1;
+  if (c == '#' && CODE_LINE_START) FILE_CODE.directives++;
+  else if (c >= '0' && c <= '9') CODE_STATE = CODE_NUMBER;
+  else if (identifier_byte(c)) CODE_STATE = CODE_IDENTIFIER;
+  else if (c == '"') CODE_STATE = CODE_STRING;
+  else if (c == '\'') CODE_STATE = CODE_CHAR;
+  else if (operator_prefix(CODE_TEXT, 1)) CODE_STATE = CODE_OPERATOR;
+  CODE_LINE_START = false;
+}
+
+void code_start() {
+  memset(&FILE_CODE, 0, sizeof(FILE_CODE));
+  CODE_STATE = CODE_NONE;
+  CODE_LINE_START = true;
+}
+
+void code_finish() {
+  if (CODE_STATE == CODE_STRING || CODE_STATE == CODE_CHAR) FILE_CODE.literals++;
+  code_token_end();
+  TOTAL_CODE.keywords += FILE_CODE.keywords;
+  TOTAL_CODE.identifiers += FILE_CODE.identifiers;
+  TOTAL_CODE.literals += FILE_CODE.literals;
+  TOTAL_CODE.operators += FILE_CODE.operators;
+  TOTAL_CODE.comments += FILE_CODE.comments;
+  TOTAL_CODE.directives += FILE_CODE.directives;
+}
+
+void report_code(struct code_stats* s) {
+  printf("      %d keywords      %d identifiers      %d literals      %d operators      %d comments      %d directives\n",
+         s->keywords, s->identifiers, s->literals, s->operators, s->comments, s->directives);
+}
+
+/*
+ * Word lists for --exclude-words and --only-words. The list is stored in a minimal perfect hash made
+ * with hash-and-displace: the words are hashed into WORD_SET_LOAD words per bucket on average, and
+ * for every bucket, largest first, a displacement is searched for that puts all of its words into
+ * free slots. There are as many slots as words, and a lookup is one hash, one displacement, and one
+ * compare against the word in the slot, which rejects the words that are not in the list. Words are
+ * compared in ASCII lower case, and words longer than WORD_SET_WORD bytes are never in a list.
+ */
+#define FILTER_EXCLUDE 1
+#define FILTER_ONLY 2
+#define WORD_SET_WORD 64
+#define WORD_SET_LOAD 4
+#define WORD_SET_TRIES 1000000
+#define WORD_SET_BUCKET 256
+
+struct word_set {
+  int size;
+  int buckets;
+  unsigned long long seed;
+  unsigned int* displacements;
+  char** slots;
+};
+
+int WORD_FILTER = 0;
+struct word_set WORD_SET;
+char FILTER_TEXT[WORD_SET_WORD];
+int FILTER_LENGTH = 0;
+
+unsigned long long word_hash(const char* p, int n, unsigned long long seed) {
+  unsigned long long h = seed ^ 14695981039346656037ULL;
+  int i;
+  for (i = 0; i < n; i++) h = (h ^ (unsigned char) p[i]) * 1099511628211ULL;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  return h ^ h >> 33;
+}
+
+unsigned int word_slot(unsigned long long h, unsigned int displacement, int size) {
+  unsigned long long x = h + displacement * 0x9E3779B97F4A7C15ULL;
+  x ^= x >> 31;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 29;
+  return x % size;
+}
+
+int word_compare(const void* a, const void* b) {
+  return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+int bucket_size_compare(const void* a, const void* b) {
+  const int* x = a;
+  const int* y = b;
+  return y[1] - x[1];
+}
+
+// Builds the perfect hash for `words', or returns false when a bucket is larger than WORD_SET_BUCKET
+// or found no displacement, and the words need another seed.
+bool word_set_build(struct word_set* set, char** words, int n) {
+  int* order = calloc(set->buckets, 2 * sizeof(int));
+  int* members = malloc(n * sizeof(int));
+  int* first = calloc(set->buckets + 1, sizeof(int));
+  unsigned int* slots = malloc(WORD_SET_BUCKET * sizeof(unsigned int));
+  int i, j, k;
+  if (order == NULL || members == NULL || first == NULL || slots == NULL) exit(EXIT_FAILURE);
+  for (i = 0; i < n; i++) set->slots[i] = NULL;
+  // Groups the words by bucket with a counting sort.
+  for (i = 0; i < n; i++) first[word_hash(words[i], strlen(words[i]), set->seed) % set->buckets + 1]++;
+  for (i = 0; i < set->buckets; i++) {
+    order[2 * i] = i;
+    order[2 * i + 1] = first[i + 1];
+    first[i + 1] += first[i];
+  }
+  int* fill = calloc(set->buckets, sizeof(int));
+  if (fill == NULL) exit(EXIT_FAILURE);
+  for (i = 0; i < n; i++) {
+    int b = word_hash(words[i], strlen(words[i]), set->seed) % set->buckets;
+    members[first[b] + fill[b]++] = i;
+  }
+  free(fill);
+  qsort(order, set->buckets, 2 * sizeof(int), bucket_size_compare);
+  bool built = true;
+  for (i = 0; i < set->buckets && built && order[2 * i + 1] > 0; i++) {
+    int b = order[2 * i], count = order[2 * i + 1];
+    unsigned int d;
+    if (count > WORD_SET_BUCKET) {
+      built = false;
+      break;
+    }
+    for (d = 0; d < WORD_SET_TRIES; d++) {
+      for (j = 0; j < count; j++) {
+        char* w = words[members[first[b] + j]];
+        slots[j] = word_slot(word_hash(w, strlen(w), set->seed), d, n);
+        if (set->slots[slots[j]] != NULL) break;
+        for (k = 0; k < j && slots[k] != slots[j]; k++);
+        if (k < j) break;
+      }
+      if (j == count) break;
+    }
+    if (d == WORD_SET_TRIES) {
+      built = false;
+      break;
+    }
+    set->displacements[b] = d;
+    for (j = 0; j < count; j++) set->slots[slots[j]] = words[members[first[b] + j]];
+  }
+  free(order);
+  free(members);
+  free(first);
+  free(slots);
+  return built;
+}
+
+void word_set_load(struct word_set* set, const char* path) {
+  char word[1024];
+  char** words = NULL;
+  int n = 0, capacity = 0, i, j;
+  FILE* file = fopen(path, "r");
+  if (file == NULL) exit(EXIT_FAILURE);
+  while (fscanf(file, "%1023s", word) == 1) {
+    if (strlen(word) > WORD_SET_WORD) continue;
+    for (i = 0; word[i] != '\0'; i++) word[i] = word[i] >= 'A' && word[i] <= 'Z' ? word[i] + 32 : word[i];
+    if (n == capacity) {
+      capacity = capacity == 0 ? 1024 : 2 * capacity;
+      words = realloc(words, capacity * sizeof(char*));
+      if (words == NULL) exit(EXIT_FAILURE);
+    }
+    words[n] = strdup(word);
+    if (words[n++] == NULL) exit(EXIT_FAILURE);
+  }
+  fclose(file);
+  // A perfect hash cannot hold a word twice.
+  qsort(words, n, sizeof(char*), word_compare);
+  for (i = j = 0; i < n; i++) {
+    if (j == 0 || strcmp(words[j - 1], words[i]) != 0) words[j++] = words[i];
+    else free(words[i]);
+  }
+  set->size = n = j;
+  set->buckets = n / WORD_SET_LOAD + 1;
+  set->displacements = calloc(set->buckets, sizeof(unsigned int));
+  set->slots = malloc((n > 0 ? n : 1) * sizeof(char*));
+  if (set->displacements == NULL || set->slots == NULL) exit(EXIT_FAILURE);
+  for (set->seed = 0; n > 0 && !word_set_build(set, words, n); set->seed++) {
+    if (set->seed == 64) exit(EXIT_FAILURE);
+  }
+  free(words);
+}
+
+bool word_set_contains(struct word_set* set, const char* p, int n) {
+  if (set->size == 0 || n > WORD_SET_WORD) return false;
+  unsigned long long h = word_hash(p, n, set->seed);
+  const char* w = set->slots[word_slot(h, set->displacements[h % set->buckets], set->size)];
+  return strlen(w) == (size_t) n && memcmp(w, p, n) == 0;
+}
+
+void filter_byte(int c) {
+  if (FILTER_LENGTH < WORD_SET_WORD) FILTER_TEXT[FILTER_LENGTH] = c >= 'A' && c <= 'Z' ? c + 32 : c;
+  FILTER_LENGTH++;
+}
+
+// Returns whether the word just read counts, and starts the next one.
+bool filter_keep() {
+  bool listed = word_set_contains(&WORD_SET, FILTER_TEXT, FILTER_LENGTH);
+  FILTER_LENGTH = 0;
+  return WORD_FILTER == FILTER_EXCLUDE ? !listed : listed;
+}
+
+/*
+ * A UTF-8 decoder that is fed a byte at a time, for the modes that need code points. Bytes that are
+ * not valid UTF-8 decode as U+FFFD, the replacement character, one for each maximal part of a
+ * sequence as the Unicode Standard recommends.
+ */
+#define UTF8_PENDING -1
+#define UTF8_REPLACEMENT 0xFFFD
+
+struct utf8 {
+  unsigned int code;
+  int pending;
+  unsigned char lower;
+  unsigned char upper;
+};
+
+// Returns the code point that `c' ends, or UTF8_PENDING. When `c' cuts a sequence short, `again' is
+// set and `c' has to be decoded again after the UTF8_REPLACEMENT for the sequence.
+int utf8_decode(struct utf8* d, unsigned char c, bool* again) {
+  *again = false;
+  if (d->pending > 0) {
+    if (c < d->lower || c > d->upper) {
+      d->pending = 0;
+      *again = true;
+      return UTF8_REPLACEMENT;
+    }
+    d->code = d->code << 6 | (c & 0x3F);
+    d->lower = 0x80;
+    d->upper = 0xBF;
+    return --d->pending == 0 ? (int) d->code : UTF8_PENDING;
+  }
+  if (c < 0x80) return c;
+  if (c < 0xC2 || c >= 0xF5) return UTF8_REPLACEMENT;
+  d->pending = c < 0xE0 ? 1 : c < 0xF0 ? 2 : 3;
+  d->code = c & (0x3F >> d->pending);
+  // The second byte rules out overlong forms, surrogates and code points above U+10FFFF.
+  d->lower = c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80;
+  d->upper = c == 0xED ? 0x9F : c == 0xF4 ? 0x8F : 0xBF;
+  return UTF8_PENDING;
+}
+
+/*
+ * Grapheme clusters for --graphemes, the user-perceived characters of UAX #29. The code points of
+ * utf8_decode() are looked up in the two-stage tables of unicode_tables.h, generated by
+ * unicode_tables.py, which give the Grapheme_Cluster_Break, Extended_Pictographic and
+ * Indic_Conjunct_Break properties in a byte. The rules only need the previous code point and three
+ * small states: emoji is 1 after an Extended_Pictographic and its Extend marks and 2 after a ZWJ
+ * following them (GB11), conjunct is 1 after an InCB consonant and its extenders and 2 once a linker
+ * follows (GB9c), and regional is whether the run of regional indicators so far is odd (GB12, GB13).
+ * ASCII never joins another ASCII byte except CR LF, so a block of 64 ASCII bytes only runs the rules
+ * for its first byte and counts the rest from its CRs.
+ */
+#include "unicode_tables.h"
+
+#define GRAPHEME_START -1
+#define GRAPHEME_ASCII 0x8080808080808080ULL
+#define GRAPHEME_ONES 0x0101010101010101ULL
+
+struct graphemes {
+  int count;
+  int previous;
+  int emoji;
+  int conjunct;
+  bool regional;
+  struct utf8 utf8;
+};
+
+bool GRAPHEMES = false;
+struct graphemes FILE_GRAPHEMES;
+int TOTAL_GRAPHEMES = 0;
+
+int grapheme_property(unsigned int cp) {
+  return GRAPHEME_STAGE2[GRAPHEME_STAGE1[cp >> GRAPHEME_SHIFT] << GRAPHEME_SHIFT | (cp & ((1 << GRAPHEME_SHIFT) - 1))];
+}
+
+void graphemes_start(struct graphemes* g) {
+  memset(g, 0, sizeof(*g));
+  g->previous = GRAPHEME_START;
+}
+
+// Whether a cluster starts before a code point with the properties `property'.
+bool grapheme_break(struct graphemes* g, int property) {
+  int before = g->previous, now = property & 15;
+  if (before == GRAPHEME_START) return true;
+  before &= 15;
+  if (before == GCB_CR && now == GCB_LF) return false;
+  if (before == GCB_CR || before == GCB_LF || before == GCB_CONTROL) return true;
+  if (now == GCB_CR || now == GCB_LF || now == GCB_CONTROL) return true;
+  if (before == GCB_L && (now == GCB_L || now == GCB_V || now == GCB_LV || now == GCB_LVT)) return false;
+  if ((before == GCB_LV || before == GCB_V) && (now == GCB_V || now == GCB_T)) return false;
+  if ((before == GCB_LVT || before == GCB_T) && now == GCB_T) return false;
+  if (now == GCB_EXTEND || now == GCB_ZWJ || now == GCB_SPACINGMARK || before == GCB_PREPEND) return false;
+  if (g->conjunct == 2 && property >> 5 == INCB_CONSONANT) return false;
+  if (g->emoji == 2 && property & GCB_PICTOGRAPHIC) return false;
+  if (before == GCB_REGIONAL_INDICATOR && now == GCB_REGIONAL_INDICATOR) return !g->regional;
+  return true;
+}
+
+void grapheme_code_point(struct graphemes* g, int property) {
+  int now = property & 15, incb = property >> 5;
+  if (grapheme_break(g, property)) g->count++;
+  if (property & GCB_PICTOGRAPHIC) g->emoji = 1;
+  else if (g->emoji == 1 && now == GCB_ZWJ) g->emoji = 2;
+  else if (g->emoji != 1 || now != GCB_EXTEND) g->emoji = 0;
+  if (incb == INCB_CONSONANT) g->conjunct = 1;
+  else if (g->conjunct != 0 && incb == INCB_LINKER) g->conjunct = 2;
+  else if (incb != INCB_EXTEND) g->conjunct = 0;
+  g->regional = now == GCB_REGIONAL_INDICATOR && !((g->previous & 15) == GCB_REGIONAL_INDICATOR && g->regional);
+  g->previous = property;
+}
+
+void grapheme_byte(struct graphemes* g, unsigned char c) {
+  bool again;
+  int cp = utf8_decode(&g->utf8, c, &again);
+  if (cp != UTF8_PENDING) grapheme_code_point(g, grapheme_property(cp));
+  if (again) grapheme_byte(g, c);
+}
+
+// Feeds a block of at most 64 bytes, taking the ASCII fast path when the block is all ASCII.
+void graphemes_block(struct graphemes* g, const unsigned char* p, int size) {
+  unsigned long long high = 0, cr = 0, word;
+  int i;
+  for (i = 0; i + 8 <= size; i += 8) {
+    memcpy(&word, p + i, 8);
+    high |= word;
+    word ^= GRAPHEME_ONES * '\r';
+    cr |= (word - GRAPHEME_ONES) & ~word & GRAPHEME_ASCII;
+  }
+  if (size < 64 || g->utf8.pending > 0 || high & GRAPHEME_ASCII) {
+    for (i = 0; i < size; i++) {
+      // A printable ASCII character starts a cluster unless a prepended mark comes before it.
+      if (p[i] >= ' ' && p[i] < 0x7F && g->utf8.pending == 0) {
+        g->count += (g->previous & 15) != GCB_PREPEND;
+        g->previous = GCB_OTHER;
+        g->emoji = g->conjunct = 0;
+        g->regional = false;
+      } else {
+        grapheme_byte(g, p[i]);
+      }
+    }
+    return;
+  }
+  grapheme_code_point(g, grapheme_property(p[0]));
+  g->count += size - 1;
+  if (cr != 0) {
+    for (i = 0; i < size - 1; i++) g->count -= p[i] == '\r' && p[i + 1] == '\n';
+  }
+  g->previous = grapheme_property(p[size - 1]);
+  g->emoji = g->conjunct = 0;
+  g->regional = false;
+}
+
+void graphemes_finish(struct graphemes* g) {
+  if (g->utf8.pending > 0) grapheme_code_point(g, grapheme_property(UTF8_REPLACEMENT));
+  g->utf8.pending = 0;
+  TOTAL_GRAPHEMES += g->count;
+}
+
+/*
+ * Display widths for --max-width, in terminal columns as wcwidth() counts them: the widths of
+ * utf8_decode()'s code points come from the WIDTH tables of unicode_tables.h, control characters
+ * take no columns, and a tab moves to the next multiple of WIDTH_TAB. A block of ASCII whose only
+ * control characters are newlines is one column a byte, so its lines are measured from the newline
+ * mask alone. WIDTH_LIMIT is the N of --max-width=N, or -1, and the lines wider than it are written
+ * with their line number into the buffer of --per-line.
+ */
+#define WIDTH_TAB 8
+#define WIDTH_ONES 0x0101010101010101ULL
+
+struct widths {
+  int line;
+  int column;
+  int widest;
+  struct utf8 utf8;
+};
+
+bool MAX_WIDTH = false;
+int WIDTH_LIMIT = -1;
+struct widths FILE_WIDTHS;
+int TOTAL_WIDTH = 0;
+
+int display_width(unsigned int cp) {
+  int i = WIDTH_STAGE1[cp >> WIDTH_SHIFT] << WIDTH_SHIFT | (cp & ((1 << WIDTH_SHIFT) - 1));
+  return WIDTH_STAGE2[i >> 2] >> 2 * (i & 3) & 3;
+}
+
+void widths_start(struct widths* w) {
+  memset(w, 0, sizeof(*w));
+}
+
+void width_line_end(struct widths* w) {
+  w->line++;
+  if (w->column > w->widest) w->widest = w->column;
+  if (WIDTH_LIMIT >= 0 && w->column > WIDTH_LIMIT) {
+    per_line_number(w->line, ':');
+    per_line_number(w->column, '\n');
+  }
+  w->column = 0;
+}
+
+void width_code_point(struct widths* w, int cp) {
+  if (cp == '\n') width_line_end(w);
+  else if (cp == '\t') w->column += WIDTH_TAB - w->column % WIDTH_TAB;
+  else w->column += display_width(cp);
+}
+
+// Feeds a block of at most 64 bytes, with the mask of its newlines.
+void widths_block(struct widths* w, const unsigned char* p, int size, unsigned long long newline) {
+  unsigned long long high = 0, word, spare;
+  int controls = 0, i;
+  for (i = 0; i + 8 <= size; i += 8) {
+    memcpy(&word, p + i, 8);
+    high |= word;
+    // The bytes below 0x20 have bits 5 and 6 clear, and DEL is the byte that is 0x7F.
+    spare = ~word & 0x6060606060606060ULL;
+    controls += __builtin_popcountll(spare & spare << 1 & 0x4040404040404040ULL);
+    spare = word ^ 0x7F7F7F7F7F7F7F7FULL;
+    controls += __builtin_popcountll(~(((spare & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | spare) & WIDTH_ONES << 7);
+  }
+  if (size < 64 || w->utf8.pending > 0 || high & WIDTH_ONES << 7 || controls != __builtin_popcountll(newline)) {
+    for (i = 0; i < size; i++) {
+      bool again;
+      int cp;
+      if (p[i] >= ' ' && p[i] < 0x7F && w->utf8.pending == 0) {
+        w->column++;
+        continue;
+      }
+      do {
+        cp = utf8_decode(&w->utf8, p[i], &again);
+        if (cp != UTF8_PENDING) width_code_point(w, cp);
+      } while (again);
+    }
+    return;
+  }
+  int from = 0;
+  while (newline != 0) {
+    int bit = __builtin_ctzll(newline);
+    w->column += bit - from;
+    width_line_end(w);
+    from = bit + 1;
+    newline &= newline - 1;
+  }
+  w->column += size - from;
+}
+
+void widths_finish(struct widths* w) {
+  if (w->utf8.pending > 0) width_code_point(w, UTF8_REPLACEMENT);
+  w->utf8.pending = 0;
+  // The last line has no newline when the stream does not end with one.
+  if (w->column > 0) width_line_end(w);
+  if (w->widest > TOTAL_WIDTH) TOTAL_WIDTH = w->widest;
+}
+
+// Writes the reports of the optional modes, after the counts of a file or after the total line.
+void report(bool total) {
+  long long start = trace_start();
+  if (TOP_LINES) report_top_lines(total ? &TOTAL_TOPK : &FILE_TOPK);
+  if (BUCKET_FORMAT) report_buckets(total ? &TOTAL_BUCKETS : &FILE_BUCKETS);
+  if (EOL) {
+    int* eols = total ? TOTAL_EOLS : FILE_EOLS;
+    printf("      %d lf      %d crlf      %d cr\n", eols[EOL_LF], eols[EOL_CRLF], eols[EOL_CR]);
+  }
+  if (JSONL) {
+    if (total) report_jsonl(TOTAL_JSON_RECORDS, TOTAL_JSON_MALFORMED, &TOTAL_KEYS);
+    else report_jsonl(JSON_RECORDS, JSON_MALFORMED, &FILE_KEYS);
+  }
+  if (PER_LINE == PER_LINE_HISTOGRAM) report_histogram(total ? &TOTAL_HISTOGRAM : &FILE_HISTOGRAM);
+  if (PROSE) report_prose(total ? &TOTAL_PROSE : &FILE_PROSE);
+  if (TOKENS) printf("      %d tokens\n", total ? TOTAL_TOKENS : FILE_TOKENS);
+  if (CODE_STATS) report_code(total ? &TOTAL_CODE : &FILE_CODE);
+  if (GRAPHEMES) printf("      %d graphemes\n", total ? TOTAL_GRAPHEMES : FILE_GRAPHEMES.count);
+  if (MAX_WIDTH) printf("      %d columns\n", total ? TOTAL_WIDTH : FILE_WIDTHS.widest);
+  trace_span("report", start, NULL, 0);
+}
+
+// Counts the lines, words, and characters of an open file, and feeds the optional modes.
+void wc_stream(FILE* file, int* line_count, int* word_count, int* char_count) {
+  int words = 0;
+  int lines = 0;
+  int chars = 0;
+  int* eols = FILE_EOLS;
+  int c;
+  int line_words = 0;
+  int line_chars = 0;
+  bool in_word = false;
+  bool line_modes = TOP_LINES || MATCH || BUCKET_FORMAT || JSONL;
+  memset(FILE_EOLS, 0, sizeof(FILE_EOLS));
+  if (TOP_LINES) topk_clear(&FILE_TOPK);
+  if (BUCKET_FORMAT) buckets_clear(&FILE_BUCKETS);
+  if (JSONL) {
+    JSON_RECORDS = JSON_MALFORMED = 0;
+    json_keys_clear(&FILE_KEYS);
+  }
+  if (PROSE) prose_start();
+  FILE_TOKENS = 0;
+  if (CODE_STATS) code_start();
+  bool counted = true;
+  bool cr = false;
+  int bom = line_modes || EOL || PROSE || TOKENS || CODE_STATS || WORD_FILTER ? 0 : utf16_bom(file);
+  if (bom) {
+    wc_utf16(file, bom == UTF16_BE, &lines, &words, &chars);
+  } else {
+    while ((c = fgetc(file)) != EOF) {
+      bool end = c == '\n';
+      int class = BYTE_CLASS[c];
+      line_chars++;
+      if (PROSE) prose_byte(c, class);
+      if (TOKENS) tokens_byte(c, class);
+      if (CODE_STATS) code_byte(c);
+      if (class & CLASS_SPACE) {
+        if (in_word && WORD_FILTER && !filter_keep()) line_words--;
+        in_word = false;
+      } else if (!in_word) {
+        in_word = true;
+        line_words++;
+      }
+      if (WORD_FILTER && !(class & CLASS_SPACE)) filter_byte(c);
+      if (EOL) {
+        if (c == '\r') {
+          eols[EOL_CR]++;
+        } else if (c == '\n' && cr) {
+          eols[EOL_CR]--;
+          eols[EOL_CRLF]++;
+        } else if (c == '\n') {
+          eols[EOL_LF]++;
+        }
+        if (EOL == EOL_CRLF) {
+          end = c == '\n' && cr;
+        } else if (EOL == EOL_CR) {
+          end = c == '\r';
+        } else if (EOL == EOL_ANY && c == '\n' && cr) {
+          // The line already ended at the <carriage-return>, the <newline> belongs to it.
+          line_chars = 0;
+          if (counted) chars++;
+          cr = false;
+          continue;
+        } else if (EOL == EOL_ANY) {
+          end = c == '\n' || c == '\r';
+        }
+        cr = c == '\r';
+      }
+      if (end) {
+        counted = !line_modes || line_end(true);
+        if (counted) {
+          lines++;
+          words += line_words;
+          chars += line_chars;
+        }
+        line_words = line_chars = 0;
+      } else if (line_modes) {
+        line_byte(c);
+      }
+    }
+    if (in_word && WORD_FILTER && !filter_keep()) line_words--;
+    if (line_chars > 0 && (!line_modes || line_end(false))) {
+      words += line_words;
+      chars += line_chars;
+    }
+  }
+  if (PROSE) prose_finish();
+  if (TOKENS) tokens_finish();
+  if (CODE_STATS) code_finish();
+  for (c = EOL_LF; c <= EOL_CR; c++) TOTAL_EOLS[c] += eols[c];
+  if (TOP_LINES) topk_merge(&TOTAL_TOPK, &FILE_TOPK);
+  if (BUCKET_FORMAT) buckets_merge(&TOTAL_BUCKETS, &FILE_BUCKETS);
+  if (JSONL) {
+    TOTAL_JSON_RECORDS += JSON_RECORDS;
+    TOTAL_JSON_MALFORMED += JSON_MALFORMED;
+    json_keys_merge(&TOTAL_KEYS, &FILE_KEYS);
+  }
+  *line_count = lines;
+  *word_count = words;
+  *char_count = chars;
+}
+
+/*
+ * Word and line boundaries for --boundaries, so that a tokenizer downstream can take the words from
+ * the offsets instead of scanning the text again. masks_update() takes the bytes of a stream as the
+ * reader of open_input() reads them, in blocks of 64 bytes, turns each block into bit masks of white
+ * space and newlines, and extracts the word starts, word ends and line ends from the masks one set
+ * bit at a time. The boundaries are encoded into a batch, which is handed to the emit function of
+ * the struct boundaries whenever it is full and at the end of the stream. The counts come from the
+ * same masks.
+ *
+ * Every boundary is the value offset << 2 | kind, where a word end is the offset just after the word
+ * and a line end is the offset of the newline, which also ends the word before it. BOUNDARY_FIXED
+ * writes each value as 8 bytes, little-endian, so boundary i is at byte 8 * i. BOUNDARY_VARINT writes
+ * the offset as the difference to the previous boundary, in LEB128 groups of 7 bits. A stream ends
+ * with a BOUNDARY_END whose offset is the length of the stream, and the next one starts at 0 again.
+ */
+#define BOUNDARY_WORD_START 0
+#define BOUNDARY_WORD_END 1
+#define BOUNDARY_LINE_END 2
+#define BOUNDARY_END 3
+#define BOUNDARY_VARINT 1
+#define BOUNDARY_FIXED 2
+#define BOUNDARY_BATCH 65536
+
+struct boundaries {
+  int format;
+  void (*emit)(const unsigned char* batch, size_t size, void* context);
+  void* context;
+  unsigned char batch[BOUNDARY_BATCH];
+  size_t used;
+  unsigned long long last;
+};
+
+FILE* BOUNDARY_OUT = NULL;
+struct boundaries BOUNDARIES = {.format = BOUNDARY_VARINT};
+
+void boundary_flush(struct boundaries* b) {
+  if (PROBE_ENABLED(output_flush)) PROBE1(output_flush, b->used);
+  if (b->used > 0) b->emit(b->batch, b->used, b->context);
+  b->used = 0;
+}
+
+void boundary_add(struct boundaries* b, unsigned long long offset, int kind) {
+  unsigned long long value;
+  int i;
+  if (b->used > BOUNDARY_BATCH - 10) boundary_flush(b);
+  if (b->format == BOUNDARY_FIXED) {
+    value = offset << 2 | kind;
+    for (i = 0; i < 8; i++) b->batch[b->used++] = value >> 8 * i;
+  } else {
+    value = (offset - b->last) << 2 | kind;
+    while (value >= 0x80) {
+      b->batch[b->used++] = value | 0x80;
+      value >>= 7;
+    }
+    b->batch[b->used++] = value;
+  }
+  b->last = offset;
+}
+
+// The state of the masks between blocks, so that the masks can also be taken from the reads of
+// another pass over the stream.
+struct masks {
+  struct boundaries* b;
+  unsigned long long offset;
+  unsigned long long space_before;
+  int line_words;
+  unsigned char last;
+  int lines;
+  int words;
+  unsigned char block[64];
+  int pending;
+};
+
+void masks_start(struct masks* m, struct boundaries* b) {
+  m->b = b;
+  m->offset = 0;
+  m->space_before = 1;
+  m->line_words = 0;
+  m->last = '\n';
+  m->lines = m->words = m->pending = 0;
+  if (b != NULL) b->last = 0;
+  if (GRAPHEMES) graphemes_start(&FILE_GRAPHEMES);
+  if (MAX_WIDTH) widths_start(&FILE_WIDTHS);
+  if (PER_LINE) {
+    PER_LINE_NUMBER = 0;
+    if (FILE_HISTOGRAM.capacity > 0) memset(FILE_HISTOGRAM.lines, 0, FILE_HISTOGRAM.capacity * sizeof(int));
+  }
+}
+
+// Takes the masks of a block of at most 64 bytes.
+void masks_block(struct masks* m, const unsigned char* p, int size) {
+  unsigned long long space = 0, newline = 0, valid = ~0ULL;
+  int i;
+  if (size < 64) valid = (1ULL << size) - 1;
+  for (i = 0; i < size; i++) {
+    space |= (unsigned long long) (BYTE_CLASS[p[i]] & CLASS_SPACE) << i;
+    newline |= (unsigned long long) (BYTE_CLASS[p[i]] >> 1 & 1) << i;
+  }
+  unsigned long long previous = space << 1 | m->space_before;
+  unsigned long long starts = ~space & previous & valid;
+  unsigned long long ends = space & ~previous & valid;
+  if (m->b != NULL) {
+    unsigned long long events = starts | ends | newline;
+    while (events != 0) {
+      int bit = __builtin_ctzll(events);
+      unsigned long long mask = 1ULL << bit;
+      if (starts & mask) boundary_add(m->b, m->offset + bit, BOUNDARY_WORD_START);
+      if (ends & mask) boundary_add(m->b, m->offset + bit, BOUNDARY_WORD_END);
+      if (newline & mask) boundary_add(m->b, m->offset + bit, BOUNDARY_LINE_END);
+      events &= events - 1;
+    }
+  }
+  if (PER_LINE) {
+    unsigned long long rest = starts, ends_of_lines = newline;
+    while (ends_of_lines != 0) {
+      unsigned long long before = (ends_of_lines & -ends_of_lines) - 1;
+      per_line(m->line_words + __builtin_popcountll(rest & before));
+      m->line_words = 0;
+      rest &= ~before;
+      ends_of_lines &= ends_of_lines - 1;
+    }
+    m->line_words += __builtin_popcountll(rest);
+  }
+  if (GRAPHEMES) graphemes_block(&FILE_GRAPHEMES, p, size);
+  if (MAX_WIDTH) widths_block(&FILE_WIDTHS, p, size, newline);
+  m->lines += __builtin_popcountll(newline);
+  m->words += __builtin_popcountll(starts);
+  m->space_before = space >> (size - 1) & 1;
+  m->offset += size;
+  m->last = p[size - 1];
+}
+
+// Takes the masks of the next `n' bytes of the stream, in whole blocks of 64 bytes. A block that
+// the bytes end inside is kept until the next call or masks_finish().
+void masks_update(struct masks* m, const unsigned char* p, size_t n) {
+  if (m->pending > 0) {
+    size_t take = 64 - m->pending < n ? 64 - m->pending : n;
+    memcpy(m->block + m->pending, p, take);
+    m->pending += take;
+    p += take;
+    n -= take;
+    if (m->pending < 64) return;
+    masks_block(m, m->block, 64);
+    m->pending = 0;
+  }
+  for (; n >= 64; p += 64, n -= 64) masks_block(m, p, 64);
+  memcpy(m->block, p, n);
+  m->pending = n;
+}
+
+void masks_finish(struct masks* m, int* lines, int* words, int* chars) {
+  if (m->pending > 0) masks_block(m, m->block, m->pending);
+  if (GRAPHEMES) graphemes_finish(&FILE_GRAPHEMES);
+  if (MAX_WIDTH) widths_finish(&FILE_WIDTHS);
+  // The last line has no newline when the stream does not end with one.
+  if (PER_LINE && m->last != '\n') per_line(m->line_words);
+  if (m->b != NULL) {
+    if (!m->space_before) boundary_add(m->b, m->offset, BOUNDARY_WORD_END);
+    boundary_add(m->b, m->offset, BOUNDARY_END);
+    boundary_flush(m->b);
+  }
+  if (PER_LINE || WIDTH_LIMIT >= 0) per_line_flush();
+  if (PER_LINE == PER_LINE_HISTOGRAM) {
+    int i;
+    for (i = 0; i < FILE_HISTOGRAM.capacity; i++) histogram_add(&TOTAL_HISTOGRAM, i, FILE_HISTOGRAM.lines[i]);
+  }
+  *lines = m->lines;
+  *words = m->words;
+  *chars = m->offset;
+}
+
+void boundary_write(const unsigned char* batch, size_t size, void* context) {
+  if (fwrite(batch, 1, size, context) != size) exit(EXIT_FAILURE);
+}
+
+// Writes the counts of a file, less what exclude_comments() found, and adds them to the totals.
+void print_counts(int lines, int words, int chars) {
+  if (L) printf("      %d", lines);
+  if (W) printf("      %d", words - WORDS_EXCLUDED);
+  if (C) printf("      %d", chars - CHARS_EXCLUDED);
+
+  TOTAL_WORDS += (words - WORDS_EXCLUDED);
+  TOTAL_LINES += lines;
+  TOTAL_CHARS += (chars - CHARS_EXCLUDED);
+
+  WORDS_EXCLUDED = CHARS_EXCLUDED = 0;
+}
+
+void wc(char* filename) {
+  int words, lines, chars;
+  long long probe = PROBE_ENABLED(file_end) ? now_ns() : 0;
+  if (PROBE_ENABLED(file_start)) PROBE1(file_start, filename);
+  if (HASH) hash_init();
+  bool plain = !TOP_LINES && !MATCH && !BUCKET_FORMAT && !JSONL && !EOL && !PROSE && !TOKENS && !CODE_STATS && !WORD_FILTER;
+  bool masks = BOUNDARY_OUT || PER_LINE || GRAPHEMES || MAX_WIDTH;
+  struct masks m;
+  if (masks) masks_start(&m, BOUNDARY_OUT ? &BOUNDARIES : NULL);
+  FILE* file = open_input(filename, HASH != 0, masks ? &m : NULL);
+  if (file != NULL) {
+    long long start = trace_start();
+    // The reader gives the bytes to the masks as they are read, so the boundaries, words per line,
+    // graphemes and widths come from the same pass as the counts. The masks give the counts too,
+    // unless a mode needs the lines or the file is UTF-16.
+    if (masks && plain && utf16_bom(file) == 0) {
+      static char drain[IO_BUFFER];
+      while (fread(drain, 1, sizeof(drain), file) > 0) continue;
+      masks_finish(&m, &lines, &words, &chars);
+    } else {
+      wc_stream(file, &lines, &words, &chars);
+      if (masks) {
+        int ignored;
+        masks_finish(&m, &ignored, &ignored, &ignored);
+      }
+    }
+    fclose(file);
+    trace_span("count", start, filename, chars);
+    if (PROBE_ENABLED(file_end)) PROBE3(file_end, filename, chars, now_ns() - probe);
+    start = trace_start();
+    print_counts(lines, words, chars);
+    if (HASH) print_hash();
+    trace_span("print", start, filename, 0);
+  }
+  else {
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Finds the words and characters of single line comments in an open file, which is read twice.
+void exclude_comments_stream(FILE* file) {
+  int c1;
+  int c2;
+  while ((c1 = fgetc(file)) != EOF) {
+    if (c1 == '/' && c2 == '/') {
+      CHARS_EXCLUDED += 2;
+      int c;
+      while((c = fgetc(file)) != '\n' && c != EOF) {
+        CHARS_EXCLUDED++;
+      }
+      c1 = c;
+    }
+    c2 = c1;
+  }
+
+  rewind(file);
+  int c; 
+  while ((c = fgetc(file)) != EOF) {
+    if (!wspace(c)) {
+      int c1 = c;
+      int c2;
+      bool no_space_before_comment = false;
+      if (c1 != '/') {
+        no_space_before_comment = true;;
+      } 
+      while (!wspace(c1) && c1 != EOF) {
+        if (c1 == '/' && c2 == '/') {
+          int c3;
+          int c4 = c1;
+          while ((c3 = fgetc(file)) != '\n' && c3 != EOF) {
+            if (!wspace(c4) && wspace(c3)) WORDS_EXCLUDED++;
+            c4 = c3;
+          }
+          if (!wspace(c4)) WORDS_EXCLUDED++;
+          if(no_space_before_comment) WORDS_EXCLUDED--;
+          c1 = c3;
+        }
+        else {
+          c2 = c1;
+          c1 = fgetc(file);
+        }
+      }
+    }
+  }
+}
+
+void exclude_comments(char* filename) {
+  long long start = trace_start();
+  FILE* file = open_input(filename, false, NULL);
+  if (file != NULL) {
+    exclude_comments_stream(file);
+    fclose(file);
+    trace_span("comments", start, filename, 0);
+  }
+  else {
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*
+ * Inflate for --git-rev, which reads zlib streams out of the object database. This is a plain
+ * decoder of DEFLATE (RFC 1951) after the lines of Mark Adler's puff: canonical Huffman codes are
+ * decoded one bit at a time from a table of code counts. The output buffer grows as needed.
+ */
+#define INFLATE_MAXBITS 15
+
+struct inflate_state {
+  const unsigned char* in;
+  size_t in_size;
+  size_t in_pos;
+  unsigned int bit_buffer;
+  int bit_count;
+  unsigned char* out;
+  size_t out_size;
+  size_t out_capacity;
+};
+
+struct huffman {
+  short count[INFLATE_MAXBITS + 1];
+  short symbol[288];
+};
+
+int inflate_bits(struct inflate_state* s, int need) {
+  long value = s->bit_buffer;
+  while (s->bit_count < need) {
+    if (s->in_pos == s->in_size) return -1;
+    value |= (long) s->in[s->in_pos++] << s->bit_count;
+    s->bit_count += 8;
+  }
+  s->bit_buffer = (unsigned int) (value >> need);
+  s->bit_count -= need;
+  return (int) (value & ((1L << need) - 1));
+}
+
+void inflate_put(struct inflate_state* s, unsigned char c) {
+  if (s->out_size == s->out_capacity) {
+    s->out_capacity = s->out_capacity ? 2 * s->out_capacity : 4096;
+    s->out = realloc(s->out, s->out_capacity);
+    if (s->out == NULL) exit(EXIT_FAILURE);
+  }
+  s->out[s->out_size++] = c;
+}
+
+int huffman_decode(struct inflate_state* s, struct huffman* h) {
+  int code = 0, first = 0, index = 0, length;
+  for (length = 1; length <= INFLATE_MAXBITS; length++) {
+    int bit = inflate_bits(s, 1);
+    if (bit < 0) return -1;
+    code |= bit;
+    int count = h->count[length];
+    if (code - count < first) return h->symbol[index + (code - first)];
+    index += count;
+    first += count;
+    first <<= 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+// Builds the decoding table from code lengths, returns false if the lengths over-subscribe.
+bool huffman_build(struct huffman* h, const short* lengths, int n) {
+  short offsets[INFLATE_MAXBITS + 1];
+  int symbol, length, left = 1;
+  memset(h->count, 0, sizeof(h->count));
+  for (symbol = 0; symbol < n; symbol++) h->count[lengths[symbol]]++;
+  for (length = 1; length <= INFLATE_MAXBITS; length++) {
+    left = (left << 1) - h->count[length];
+    if (left < 0) return false;
+  }
+  offsets[1] = 0;
+  for (length = 1; length < INFLATE_MAXBITS; length++) offsets[length + 1] = offsets[length] + h->count[length];
+  for (symbol = 0; symbol < n; symbol++) {
+    if (lengths[symbol] != 0) h->symbol[offsets[lengths[symbol]]++] = symbol;
+  }
+  return true;
+}
+
+bool inflate_codes(struct inflate_state* s, struct huffman* lengthcode, struct huffman* distcode) {
+  static const short base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const short extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  static const short distance_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                          193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                          6145, 8193, 12289, 16385, 24577};
+  static const short distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                           7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+  while (true) {
+    int symbol = huffman_decode(s, lengthcode);
+    if (symbol < 0) return false;
+    if (symbol < 256) {
+      inflate_put(s, symbol);
+    } else if (symbol == 256) {
+      return true;
+    } else {
+      symbol -= 257;
+      if (symbol >= 29) return false;
+      int more = inflate_bits(s, extra[symbol]);
+      int distance_symbol = huffman_decode(s, distcode);
+      if (more < 0 || distance_symbol < 0 || distance_symbol >= 30) return false;
+      int length = base[symbol] + more;
+      int distance_more = inflate_bits(s, distance_extra[distance_symbol]);
+      if (distance_more < 0) return false;
+      size_t distance = distance_base[distance_symbol] + distance_more;
+      if (distance > s->out_size) return false;
+      while (length-- > 0) inflate_put(s, s->out[s->out_size - distance]);
+    }
+  }
+}
+
+bool inflate_stored(struct inflate_state* s) {
+  s->bit_buffer = 0;
+  s->bit_count = 0;
+  if (s->in_pos + 4 > s->in_size) return false;
+  unsigned int length = s->in[s->in_pos] | s->in[s->in_pos + 1] << 8;
+  unsigned int complement = s->in[s->in_pos + 2] | s->in[s->in_pos + 3] << 8;
+  s->in_pos += 4;
+  if (length != (~complement & 0xffff) || s->in_pos + length > s->in_size) return false;
+  while (length-- > 0) inflate_put(s, s->in[s->in_pos++]);
+  return true;
+}
+
+bool inflate_fixed(struct inflate_state* s) {
+  static struct huffman lengthcode, distcode;
+  static bool built = false;
+  if (!built) {
+    short lengths[288];
+    int symbol;
+    for (symbol = 0; symbol < 144; symbol++) lengths[symbol] = 8;
+    for (; symbol < 256; symbol++) lengths[symbol] = 9;
+    for (; symbol < 280; symbol++) lengths[symbol] = 7;
+    for (; symbol < 288; symbol++) lengths[symbol] = 8;
+    huffman_build(&lengthcode, lengths, 288);
+    for (symbol = 0; symbol < 30; symbol++) lengths[symbol] = 5;
+    huffman_build(&distcode, lengths, 30);
+    built = true;
+  }
+  return inflate_codes(s, &lengthcode, &distcode);
+}
+
+bool inflate_dynamic(struct inflate_state* s) {
+  static const short order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+  struct huffman lengthcode, distcode;
+  short lengths[320];
+  int nlen = inflate_bits(s, 5) + 257;
+  int ndist = inflate_bits(s, 5) + 1;
+  int ncode = inflate_bits(s, 4) + 4;
+  int index;
+  if (nlen < 257 || nlen > 286 || ndist < 1 || ndist > 30 || ncode < 4) return false;
+  for (index = 0; index < 19; index++) lengths[order[index]] = 0;
+  for (index = 0; index < ncode; index++) {
+    int length = inflate_bits(s, 3);
+    if (length < 0) return false;
+    lengths[order[index]] = length;
+  }
+  if (!huffman_build(&lengthcode, lengths, 19)) return false;
+  index = 0;
+  while (index < nlen + ndist) {
+    int symbol = huffman_decode(s, &lengthcode);
+    int length = 0, repeat, more;
+    if (symbol < 0) return false;
+    if (symbol < 16) {
+      lengths[index++] = symbol;
+      continue;
+    }
+    if (symbol == 16) {
+      if (index == 0) return false;
+      length = lengths[index - 1];
+      repeat = 3 + (more = inflate_bits(s, 2));
+    } else if (symbol == 17) {
+      repeat = 3 + (more = inflate_bits(s, 3));
+    } else {
+      repeat = 11 + (more = inflate_bits(s, 7));
+    }
+    if (more < 0 || index + repeat > nlen + ndist) return false;
+    while (repeat-- > 0) lengths[index++] = length;
+  }
+  if (lengths[256] == 0) return false;
+  if (!huffman_build(&lengthcode, lengths, nlen) || !huffman_build(&distcode, lengths + nlen, ndist))
+    return false;
+  return inflate_codes(s, &lengthcode, &distcode);
+}
+
+// Inflates the zlib stream at `in' into a malloc()ed buffer. Returns NULL if the stream is broken.
+unsigned char* zlib_inflate(const unsigned char* in, size_t in_size, size_t size_hint, size_t* out_size) {
+  struct inflate_state s;
+  int last;
+  memset(&s, 0, sizeof(s));
+  if (in_size < 2 || (in[0] & 0x0f) != 8 || ((in[0] << 8) | in[1]) % 31 != 0) return NULL;
+  s.in = in + 2;
+  s.in_size = in_size - 2;
+  s.out_capacity = size_hint + 1;
+  s.out = malloc(s.out_capacity);
+  if (s.out == NULL) exit(EXIT_FAILURE);
+  do {
+    last = inflate_bits(&s, 1);
+    int type = inflate_bits(&s, 2);
+    bool ok = type == 0 ? inflate_stored(&s) : type == 1 ? inflate_fixed(&s) : type == 2 ? inflate_dynamic(&s) : false;
+    if (last < 0 || !ok) {
+      free(s.out);
+      return NULL;
+    }
+  } while (!last);
+  *out_size = s.out_size;
+  return s.out;
+}
+
+/*
+ * Counting a revision for --git-rev. REV is resolved to a commit through the refs of the repository,
+ * its tree is walked, and every regular file's blob is counted from memory, without a checkout.
+ * Objects are looked up in the pack index files first and then as loose objects. Deltified pack
+ * entries are rebuilt from their base, and recently used bases are cached by pack offset, because
+ * long delta chains share them. The counts of every blob are cached by blob id in mywc-cache in the
+ * git directory, so unchanged files are free when another revision is counted. Only plain counts
+ * are cached, since -C and the line-based modes depend on more than the blob.
+ */
+#define GIT_COMMIT 1
+#define GIT_TREE 2
+#define GIT_BLOB 3
+#define GIT_TAG 4
+#define GIT_OFS_DELTA 6
+#define GIT_REF_DELTA 7
+#define GIT_BASES 64
+
+struct git_pack {
+  const unsigned char* index;
+  size_t index_size;
+  const unsigned char* data;
+  size_t data_size;
+  unsigned int objects;
+};
+
+struct git_base {
+  struct git_pack* pack;
+  unsigned long long offset;
+  int type;
+  unsigned char* data;
+  size_t size;
+};
+
+struct git_cached {
+  unsigned char id[20];
+  int lines;
+  int words;
+  int chars;
+  bool used;
+};
+
+char* GIT_REV = NULL;
+char GIT_DIR[4096];
+struct git_pack* GIT_PACKS = NULL;
+int GIT_PACK_COUNT = 0;
+struct git_base GIT_BASE_CACHE[GIT_BASES];
+struct git_cached* GIT_CACHE = NULL;
+int GIT_CACHE_SIZE = 0;
+int GIT_CACHE_CAPACITY = 0;
+FILE* GIT_CACHE_FILE = NULL;
+
+bool hex_to_id(const char* hex, unsigned char* id) {
+  int i;
+  for (i = 0; i < 20; i++) {
+    int high = hex[2 * i], low = hex[2 * i + 1];
+    if (!hex_digit(high) || !hex_digit(low)) return false;
+    high = high <= '9' ? high - '0' : (high | 32) - 'a' + 10;
+    low = low <= '9' ? low - '0' : (low | 32) - 'a' + 10;
+    id[i] = high << 4 | low;
+  }
+  return true;
+}
+
+void id_to_hex(const unsigned char* id, char* hex) {
+  int i;
+  for (i = 0; i < 20; i++) sprintf(hex + 2 * i, "%02x", id[i]);
+}
+
+unsigned int read_be32(const unsigned char* p) {
+  return (unsigned int) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+const unsigned char* map_file(const char* path, size_t* size) {
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return NULL;
+  *size = st.st_size;
+  return p;
+}
+
+void git_open_packs() {
+  char path[8192];
+  struct dirent* entry;
+  snprintf(path, sizeof(path), "%s/objects/pack", GIT_DIR);
+  DIR* dir = opendir(path);
+  if (dir == NULL) return;
+  while ((entry = readdir(dir)) != NULL) {
+    int length = strlen(entry->d_name);
+    struct git_pack pack;
+    if (length < 5 || strcmp(entry->d_name + length - 4, ".idx") != 0) continue;
+    snprintf(path, sizeof(path), "%s/objects/pack/%s", GIT_DIR, entry->d_name);
+    pack.index = map_file(path, &pack.index_size);
+    strcpy(path + strlen(path) - 4, ".pack");
+    pack.data = map_file(path, &pack.data_size);
+    if (pack.index == NULL || pack.data == NULL || pack.index_size < 8 + 1024 ||
+        memcmp(pack.index, "\377tOc\0\0\0\2", 8) != 0)
+      exit(EXIT_FAILURE);
+    pack.objects = read_be32(pack.index + 8 + 255 * 4);
+    GIT_PACKS = realloc(GIT_PACKS, (GIT_PACK_COUNT + 1) * sizeof(struct git_pack));
+    if (GIT_PACKS == NULL) exit(EXIT_FAILURE);
+    GIT_PACKS[GIT_PACK_COUNT++] = pack;
+  }
+  closedir(dir);
+}
+
+// Finds the offset of an object in a version 2 pack index, by binary search within its fan-out
+// bucket.
+bool git_pack_find(struct git_pack* pack, const unsigned char* id, unsigned long long* offset) {
+  const unsigned char* fanout = pack->index + 8;
+  const unsigned char* ids = fanout + 1024;
+  unsigned int low = id[0] == 0 ? 0 : read_be32(fanout + 4 * (id[0] - 1));
+  unsigned int high = read_be32(fanout + 4 * id[0]);
+  while (low < high) {
+    unsigned int middle = low + (high - low) / 2;
+    int compare = memcmp(ids + 20 * (size_t) middle, id, 20);
+    if (compare == 0) {
+      const unsigned char* offsets = ids + 24 * (size_t) pack->objects;
+      unsigned int small = read_be32(offsets + 4 * (size_t) middle);
+      if (small & 0x80000000u) {
+        const unsigned char* large = offsets + 4 * (size_t) pack->objects + 8 * (size_t) (small & 0x7fffffffu);
+        *offset = (unsigned long long) read_be32(large) << 32 | read_be32(large + 4);
+      } else {
+        *offset = small;
+      }
+      return true;
+    }
+    if (compare < 0) low = middle + 1;
+    else high = middle;
+  }
+  return false;
+}
+
+unsigned char* git_read_object(const unsigned char* id, int* type, size_t* size);
+
+// Applies a git delta to `base', returns NULL if the delta does not fit it.
+unsigned char* git_apply_delta(const unsigned char* base, size_t base_size, const unsigned char* delta,
+                               size_t delta_size, size_t* size) {
+  const unsigned char* end = delta + delta_size;
+  size_t source = 0, target = 0;
+  int shift;
+  for (shift = 0; delta < end; shift += 7) {
+    source |= (size_t) (*delta & 0x7f) << shift;
+    if (!(*delta++ & 0x80)) break;
+  }
+  for (shift = 0; delta < end; shift += 7) {
+    target |= (size_t) (*delta & 0x7f) << shift;
+    if (!(*delta++ & 0x80)) break;
+  }
+  if (source != base_size) return NULL;
+  unsigned char* out = malloc(target + 1);
+  size_t written = 0;
+  if (out == NULL) exit(EXIT_FAILURE);
+  while (delta < end) {
+    unsigned char op = *delta++;
+    if (op & 0x80) {
+      size_t offset = 0, length = 0;
+      int i;
+      for (i = 0; i < 4; i++) {
+        if (op & (1 << i)) offset |= (size_t) (delta < end ? *delta++ : 0) << (8 * i);
+      }
+      for (i = 0; i < 3; i++) {
+        if (op & (16 << i)) length |= (size_t) (delta < end ? *delta++ : 0) << (8 * i);
+      }
+      if (length == 0) length = 0x10000;
+      if (offset + length > base_size || written + length > target) break;
+      memcpy(out + written, base + offset, length);
+      written += length;
+    } else if (op != 0 && delta + op <= end && written + op <= target) {
+      memcpy(out + written, delta, op);
+      delta += op;
+      written += op;
+    } else {
+      break;
+    }
+  }
+  if (delta != end || written != target) {
+    free(out);
+    return NULL;
+  }
+  *size = target;
+  return out;
+}
+
+// Reads the entry at `offset' of a pack, resolving deltas against their base. The result is owned
+// by the base cache and must not be freed.
+unsigned char* git_pack_read(struct git_pack* pack, unsigned long long offset, int* type, size_t* size) {
+  struct git_base* cached = &GIT_BASE_CACHE[(offset ^ (offset >> 12)) % GIT_BASES];
+  if (cached->data != NULL && cached->pack == pack && cached->offset == offset) {
+    *type = cached->type;
+    *size = cached->size;
+    return cached->data;
+  }
+  const unsigned char* p = pack->data + offset;
+  const unsigned char* end = pack->data + pack->data_size;
+  if (offset >= pack->data_size) exit(EXIT_FAILURE);
+  unsigned char c = *p++;
+  size_t length = c & 0x0f;
+  int shift = 4;
+  *type = (c >> 4) & 7;
+  while ((c & 0x80) && p < end) {
+    c = *p++;
+    length |= (size_t) (c & 0x7f) << shift;
+    shift += 7;
+  }
+  unsigned char* data;
+  if (*type == GIT_OFS_DELTA || *type == GIT_REF_DELTA) {
+    unsigned char* base;
+    size_t base_size;
+    if (*type == GIT_OFS_DELTA) {
+      unsigned long long distance = *p & 0x7f;
+      while ((*p++ & 0x80) && p < end) distance = ((distance + 1) << 7) | (*p & 0x7f);
+      if (distance > offset) exit(EXIT_FAILURE);
+      base = git_pack_read(pack, offset - distance, type, &base_size);
+      base = memcpy(malloc(base_size + 1), base, base_size);
+    } else {
+      if (p + 20 > end) exit(EXIT_FAILURE);
+      base = git_read_object(p, type, &base_size);
+      p += 20;
+    }
+    size_t delta_size;
+    unsigned char* delta = zlib_inflate(p, end - p, length, &delta_size);
+    if (base == NULL || delta == NULL) exit(EXIT_FAILURE);
+    data = git_apply_delta(base, base_size, delta, delta_size, size);
+    free(base);
+    free(delta);
+  } else {
+    data = zlib_inflate(p, end - p, length, size);
+  }
+  if (data == NULL) exit(EXIT_FAILURE);
+  free(cached->data);
+  cached->pack = pack;
+  cached->offset = offset;
+  cached->type = *type;
+  cached->data = data;
+  cached->size = *size;
+  return data;
+}
+
+// Reads an object by id from the packs or the loose objects. The result is malloc()ed.
+unsigned char* git_read_object(const unsigned char* id, int* type, size_t* size) {
+  unsigned long long offset;
+  char hex[41];
+  char path[8192];
+  int i;
+  for (i = 0; i < GIT_PACK_COUNT; i++) {
+    if (git_pack_find(&GIT_PACKS[i], id, &offset)) {
+      unsigned char* data = git_pack_read(&GIT_PACKS[i], offset, type, size);
+      unsigned char* copy = malloc(*size + 1);
+      if (copy == NULL) exit(EXIT_FAILURE);
+      return memcpy(copy, data, *size);
+    }
+  }
+  id_to_hex(id, hex);
+  snprintf(path, sizeof(path), "%s/objects/%.2s/%s", GIT_DIR, hex, hex + 2);
+  size_t compressed_size, inflated_size;
+  const unsigned char* compressed = map_file(path, &compressed_size);
+  if (compressed == NULL) return NULL;
+  unsigned char* inflated = zlib_inflate(compressed, compressed_size, 4 * compressed_size, &inflated_size);
+  munmap((void*) compressed, compressed_size);
+  if (inflated == NULL) exit(EXIT_FAILURE);
+  unsigned char* header_end = memchr(inflated, '\0', inflated_size);
+  if (header_end == NULL) exit(EXIT_FAILURE);
+  if (strncmp((char*) inflated, "commit ", 7) == 0) *type = GIT_COMMIT;
+  else if (strncmp((char*) inflated, "tree ", 5) == 0) *type = GIT_TREE;
+  else if (strncmp((char*) inflated, "blob ", 5) == 0) *type = GIT_BLOB;
+  else if (strncmp((char*) inflated, "tag ", 4) == 0) *type = GIT_TAG;
+  else exit(EXIT_FAILURE);
+  *size = inflated + inflated_size - header_end - 1;
+  memmove(inflated, header_end + 1, *size);
+  return inflated;
+}
+
+// Resolves a ref name, following symbolic refs, from its file or from packed-refs.
+bool git_resolve_ref(const char* name, unsigned char* id, int depth) {
+  char path[8192];
+  char line[8192];
+  FILE* file;
+  snprintf(path, sizeof(path), "%s/%s", GIT_DIR, name);
+  if (depth < 8 && (file = fopen(path, "r")) != NULL) {
+    bool found = fgets(line, sizeof(line), file) != NULL;
+    fclose(file);
+    if (found && strncmp(line, "ref: ", 5) == 0) {
+      line[strcspn(line, "\r\n")] = '\0';
+      return git_resolve_ref(line + 5, id, depth + 1);
+    }
+    if (found && hex_to_id(line, id)) return true;
+  }
+  snprintf(path, sizeof(path), "%s/packed-refs", GIT_DIR);
+  if ((file = fopen(path, "r")) == NULL) return false;
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+    found = strlen(line) > 41 && strcmp(line + 41, name) == 0 && hex_to_id(line, id);
+  }
+  fclose(file);
+  return found;
+}
+
+// Resolves REV, a full object id or a ref name the way git abbreviates them, to a tree id.
+void git_resolve_tree(const char* rev, unsigned char* id) {
+  static const char* prefixes[] = {"", "refs/", "refs/tags/", "refs/heads/", "refs/remotes/"};
+  char name[4096];
+  int i, type;
+  size_t size;
+  bool found = strlen(rev) == 40 && hex_to_id(rev, id);
+  for (i = 0; !found && i < 5; i++) {
+    snprintf(name, sizeof(name), "%s%s", prefixes[i], rev);
+    found = git_resolve_ref(name, id, 0);
+  }
+  if (!found) exit(EXIT_FAILURE);
+  while (true) {
+    unsigned char* data = git_read_object(id, &type, &size);
+    if (data == NULL) exit(EXIT_FAILURE);
+    if (type == GIT_TREE) {
+      free(data);
+      return;
+    }
+    // Commits start with `tree <id>', annotated tags with `object <id>'.
+    const char* field = type == GIT_COMMIT ? "tree " : "object ";
+    if ((type != GIT_COMMIT && type != GIT_TAG) || size < strlen(field) + 40 ||
+        strncmp((char*) data, field, strlen(field)) != 0 || !hex_to_id((char*) data + strlen(field), id))
+      exit(EXIT_FAILURE);
+    free(data);
+  }
+}
+
+struct git_cached* git_cache_slot(const unsigned char* id) {
+  unsigned int i = read_be32(id) & (GIT_CACHE_CAPACITY - 1);
+  while (GIT_CACHE[i].used && memcmp(GIT_CACHE[i].id, id, 20) != 0) i = (i + 1) & (GIT_CACHE_CAPACITY - 1);
+  return &GIT_CACHE[i];
+}
+
+void git_cache_add(const unsigned char* id, int lines, int words, int chars) {
+  if (2 * (GIT_CACHE_SIZE + 1) > GIT_CACHE_CAPACITY) {
+    struct git_cached* old = GIT_CACHE;
+    int old_capacity = GIT_CACHE_CAPACITY, i;
+    GIT_CACHE_CAPACITY = GIT_CACHE_CAPACITY ? 2 * GIT_CACHE_CAPACITY : 4096;
+    GIT_CACHE = calloc(GIT_CACHE_CAPACITY, sizeof(struct git_cached));
+    if (GIT_CACHE == NULL) exit(EXIT_FAILURE);
+    for (i = 0; i < old_capacity; i++) {
+      if (old[i].used) *git_cache_slot(old[i].id) = old[i];
+    }
+    free(old);
+  }
+  struct git_cached* slot = git_cache_slot(id);
+  if (!slot->used) GIT_CACHE_SIZE++;
+  memcpy(slot->id, id, 20);
+  slot->lines = lines;
+  slot->words = words;
+  slot->chars = chars;
+  slot->used = true;
+}
+
+// Loads mywc-cache and keeps it open for appending. Each line holds a blob id and its counts.
+void git_cache_open() {
+  char path[8192];
+  char hex[41];
+  unsigned char id[20];
+  int lines, words, chars;
+  snprintf(path, sizeof(path), "%s/mywc-cache", GIT_DIR);
+  GIT_CACHE_FILE = fopen(path, "a+");
+  if (GIT_CACHE_FILE == NULL) return;
+  rewind(GIT_CACHE_FILE);
+  while (fscanf(GIT_CACHE_FILE, "%40s %d %d %d", hex, &lines, &words, &chars) == 4) {
+    if (hex_to_id(hex, id)) git_cache_add(id, lines, words, chars);
+  }
+}
+
+// Counts a blob, from the cache when possible, and writes its counts like those of a file.
+void git_count_blob(const unsigned char* id, const char* path, bool ellide_comments) {
+  bool masks = BOUNDARY_OUT || PER_LINE || GRAPHEMES || MAX_WIDTH;
+  bool cacheable = !ellide_comments && !TOP_LINES && !MATCH && !BUCKET_FORMAT && !JSONL && !EOL && !HASH && !PROSE &&
+                   !TOKENS && !CODE_STATS && !WORD_FILTER && !masks;
+  int lines, words, chars, type;
+  size_t size;
+  if (cacheable && GIT_CACHE_CAPACITY > 0 && git_cache_slot(id)->used) {
+    struct git_cached* cached = git_cache_slot(id);
+    if (PROBE_ENABLED(cache_hit)) PROBE2(cache_hit, "git", cached->chars);
+    print_counts(cached->lines, cached->words, cached->chars);
+    printf(" %s\n", path);
+    return;
+  }
+  long long start = trace_start();
+  unsigned char* data = git_read_object(id, &type, &size);
+  if (data == NULL || type != GIT_BLOB) exit(EXIT_FAILURE);
+  trace_span("object", start, path, size);
+  if (cacheable && PROBE_ENABLED(cache_miss)) PROBE2(cache_miss, "git", size);
+  start = trace_start();
+  FILE* file = fmemopen(data, size, "r");
+  if (file == NULL) exit(EXIT_FAILURE);
+  if (ellide_comments) exclude_comments_stream(file);
+  rewind(file);
+  wc_stream(file, &lines, &words, &chars);
+  fclose(file);
+  // The blob is in memory, so the masks take it whole instead of from the reads of wc_stream().
+  if (masks) {
+    struct masks m;
+    int ignored;
+    masks_start(&m, BOUNDARY_OUT ? &BOUNDARIES : NULL);
+    masks_update(&m, data, size);
+    masks_finish(&m, &ignored, &ignored, &ignored);
+  }
+  trace_span("count", start, path, size);
+  print_counts(lines, words, chars);
+  if (HASH) {
+    hash_init();
+    hash_update(data, size);
+    print_hash();
+  }
+  free(data);
+  printf(" %s\n", path);
+  report(false);
+  if (cacheable) {
+    char hex[41];
+    git_cache_add(id, lines, words, chars);
+    id_to_hex(id, hex);
+    if (GIT_CACHE_FILE != NULL) fprintf(GIT_CACHE_FILE, "%s %d %d %d\n", hex, lines, words, chars);
+  }
+}
+
+// Counts the regular files of a tree and its subtrees, returns the number of files.
+int git_count_tree(const unsigned char* id, const char* prefix, bool ellide_comments) {
+  int type, files = 0;
+  size_t size;
+  unsigned char* tree = git_read_object(id, &type, &size);
+  unsigned char* p = tree;
+  if (tree == NULL || type != GIT_TREE) exit(EXIT_FAILURE);
+  // Entries are `<octal mode> <name>\0' followed by the 20 byte object id.
+  while (p < tree + size) {
+    unsigned char* name = memchr(p, ' ', tree + size - p);
+    unsigned char* name_end = name == NULL ? NULL : memchr(name, '\0', tree + size - name);
+    if (name_end == NULL || name_end + 21 > tree + size) exit(EXIT_FAILURE);
+    long mode = strtol((char*) p, NULL, 8);
+    char* path = malloc(strlen(prefix) + (name_end - name) + 1);
+    if (path == NULL) exit(EXIT_FAILURE);
+    sprintf(path, "%s%s", prefix, (char*) name + 1);
+    if (mode == 040000) {
+      strcat(path, "/");
+      files += git_count_tree(name_end + 1, path, ellide_comments);
+    } else if ((mode & 0170000) == 0100000) {
+      git_count_blob(name_end + 1, path, ellide_comments);
+      files++;
+    }
+    free(path);
+    p = name_end + 21;
+  }
+  free(tree);
+  return files;
+}
+
+// Counts the files of revision GIT_REV of the repository at `repo', returns the number of files.
+int git_count(char* repo, bool ellide_comments) {
+  unsigned char tree[20];
+  struct stat st;
+  int i;
+  for (i = 0; i < GIT_BASES; i++) {
+    free(GIT_BASE_CACHE[i].data);
+    GIT_BASE_CACHE[i].data = NULL;
+  }
+  free(GIT_CACHE);
+  GIT_CACHE = NULL;
+  GIT_CACHE_SIZE = GIT_CACHE_CAPACITY = GIT_PACK_COUNT = 0;
+  snprintf(GIT_DIR, sizeof(GIT_DIR), "%s/.git", repo);
+  if (stat(GIT_DIR, &st) != 0 || !S_ISDIR(st.st_mode)) snprintf(GIT_DIR, sizeof(GIT_DIR), "%s", repo);
+  git_open_packs();
+  git_cache_open();
+  git_resolve_tree(GIT_REV, tree);
+  int files = git_count_tree(tree, "", ellide_comments);
+  if (GIT_CACHE_FILE != NULL) fclose(GIT_CACHE_FILE);
+  return files;
+}
+
+/*
+ * Snapshots for --snapshot and --diff-against. A snapshot is a text file with one line per counted
+ * file: its device, inode, modification time and size, its counts and, last, its path. When a
+ * snapshot is diffed against, a file whose identity is unchanged is not read at all and keeps the
+ * counts of the snapshot, so only the files that changed since the snapshot cost a count.
+ */
+struct snapshot_entry {
+  char* path;
+  unsigned long long dev;
+  unsigned long long ino;
+  long long mtime_sec;
+  long mtime_nsec;
+  long long size;
+  int lines;
+  int words;
+  int chars;
+  bool seen;
+};
+
+struct snapshot {
+  struct snapshot_entry* slots;
+  int size;
+  int capacity;
+};
+
+char* SNAPSHOT_OUT = NULL;
+char* DIFF_AGAINST = NULL;
+struct snapshot OLD_SNAPSHOT;
+struct snapshot NEW_SNAPSHOT;
+int DIFF_LINES = 0;
+int DIFF_WORDS = 0;
+int DIFF_CHARS = 0;
+
+unsigned int snapshot_hash(char* path) {
+  unsigned int hash = 2166136261u;
+  char* p;
+  for (p = path; *p != '\0'; p++) hash = (hash ^ (unsigned char) *p) * 16777619u;
+  return hash;
+}
+
+struct snapshot_entry* snapshot_slot(struct snapshot* s, char* path) {
+  unsigned int i = snapshot_hash(path) & (s->capacity - 1);
+  while (s->slots[i].path != NULL && strcmp(s->slots[i].path, path) != 0) i = (i + 1) & (s->capacity - 1);
+  return &s->slots[i];
+}
+
+void snapshot_add(struct snapshot* s, struct snapshot_entry* entry) {
+  if (2 * (s->size + 1) > s->capacity) {
+    struct snapshot old = *s;
+    int i;
+    s->size = 0;
+    s->capacity = s->capacity ? 2 * s->capacity : 1024;
+    s->slots = calloc(s->capacity, sizeof(struct snapshot_entry));
+    if (s->slots == NULL) exit(EXIT_FAILURE);
+    for (i = 0; i < old.capacity; i++) {
+      if (old.slots[i].path != NULL) snapshot_add(s, &old.slots[i]);
+    }
+    free(old.slots);
+  }
+  struct snapshot_entry* slot = snapshot_slot(s, entry->path);
+  if (slot->path == NULL) s->size++;
+  *slot = *entry;
+}
+
+// Removes the entry of a path, moving back the entries after it that would not be found anymore.
+// The path of the entry is left to the caller.
+void snapshot_remove(struct snapshot* s, char* path) {
+  if (s->capacity == 0) return;
+  unsigned int mask = s->capacity - 1;
+  unsigned int hole = snapshot_slot(s, path) - s->slots, i = hole;
+  if (s->slots[hole].path == NULL) return;
+  s->slots[hole].path = NULL;
+  s->size--;
+  while (s->slots[i = (i + 1) & mask].path != NULL) {
+    unsigned int home = snapshot_hash(s->slots[i].path) & mask;
+    // The entry may move when the hole is between its home slot and its slot.
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      s->slots[hole] = s->slots[i];
+      s->slots[i].path = NULL;
+      hole = i;
+    }
+  }
+}
+
+void snapshot_load(char* filename) {
+  FILE* file = fopen(filename, "r");
+  struct snapshot_entry entry;
+  char* line = NULL;
+  size_t capacity = 0;
+  ssize_t length;
+  int path;
+  if (file == NULL) exit(EXIT_FAILURE);
+  while ((length = getline(&line, &capacity, file)) > 0) {
+    if (line[length - 1] == '\n') line[length - 1] = '\0';
+    memset(&entry, 0, sizeof(entry));
+    if (sscanf(line, "%llu %llu %lld %ld %lld %d %d %d %n", &entry.dev, &entry.ino, &entry.mtime_sec,
+               &entry.mtime_nsec, &entry.size, &entry.lines, &entry.words, &entry.chars, &path) < 8)
+      exit(EXIT_FAILURE);
+    entry.path = strdup(line + path);
+    if (entry.path == NULL) exit(EXIT_FAILURE);
+    snapshot_add(&OLD_SNAPSHOT, &entry);
+  }
+  free(line);
+  fclose(file);
+}
+
+// Writes the snapshot to a temporary file first, so an interrupted run keeps the old snapshot.
+void snapshot_save(char* filename) {
+  char* temporary = malloc(strlen(filename) + 5);
+  int i;
+  if (temporary == NULL) exit(EXIT_FAILURE);
+  sprintf(temporary, "%s.new", filename);
+  FILE* file = fopen(temporary, "w");
+  if (file == NULL) exit(EXIT_FAILURE);
+  for (i = 0; i < NEW_SNAPSHOT.capacity; i++) {
+    struct snapshot_entry* e = &NEW_SNAPSHOT.slots[i];
+    if (e->path != NULL) {
+      fprintf(file, "%llu %llu %lld %ld %lld %d %d %d %s\n", e->dev, e->ino, e->mtime_sec, e->mtime_nsec,
+              e->size, e->lines, e->words, e->chars, e->path);
+    }
+  }
+  if (fclose(file) != 0 || rename(temporary, filename) != 0) exit(EXIT_FAILURE);
+  free(temporary);
+}
+
+// Counts an open file like wc() does, without writing anything, less what exclude_comments() found,
+// and closes it.
+void count_stream(FILE* file, bool ellide_comments, int* lines, int* words, int* chars) {
+  if (ellide_comments) exclude_comments_stream(file);
+  rewind(file);
+  wc_stream(file, lines, words, chars);
+  fclose(file);
+  *words -= WORDS_EXCLUDED;
+  *chars -= CHARS_EXCLUDED;
+  WORDS_EXCLUDED = CHARS_EXCLUDED = 0;
+}
+
+void count_file(char* filename, bool ellide_comments, int* lines, int* words, int* chars) {
+  FILE* file = open_input(filename, false, NULL);
+  if (file == NULL) exit(EXIT_FAILURE);
+  count_stream(file, ellide_comments, lines, words, chars);
+}
+
+void print_delta(int lines, int words, int chars, char status, char* path) {
+  if (L) printf("      %+d", lines);
+  if (W) printf("      %+d", words);
+  if (C) printf("      %+d", chars);
+  if (status) printf(" %c %s\n", status, path);
+  else printf(" %s\n", path);
+  DIFF_LINES += lines;
+  DIFF_WORDS += words;
+  DIFF_CHARS += chars;
+}
+
+// Counts a file operand when a snapshot is saved or diffed against. Without --diff-against, its
+// counts are written as usual.
+void snapshot_file(char* filename, bool ellide_comments) {
+  struct snapshot_entry entry;
+  struct snapshot_entry* old = NULL;
+  struct stat st;
+  if (stat(filename, &st) != 0) exit(EXIT_FAILURE);
+  memset(&entry, 0, sizeof(entry));
+  entry.path = filename;
+  entry.dev = st.st_dev;
+  entry.ino = st.st_ino;
+  entry.mtime_sec = st.st_mtim.tv_sec;
+  entry.mtime_nsec = st.st_mtim.tv_nsec;
+  entry.size = st.st_size;
+  if (DIFF_AGAINST != NULL && OLD_SNAPSHOT.capacity > 0) {
+    old = snapshot_slot(&OLD_SNAPSHOT, filename);
+    if (old->path == NULL) old = NULL;
+  }
+  if (old != NULL && old->dev == entry.dev && old->ino == entry.ino && old->mtime_sec == entry.mtime_sec &&
+      old->mtime_nsec == entry.mtime_nsec && old->size == entry.size) {
+    entry.lines = old->lines;
+    entry.words = old->words;
+    entry.chars = old->chars;
+  } else {
+    count_file(filename, ellide_comments, &entry.lines, &entry.words, &entry.chars);
+  }
+  if (DIFF_AGAINST == NULL) {
+    print_counts(entry.lines, entry.words, entry.chars);
+    printf(" %s\n", filename);
+    report(false);
+  } else if (old == NULL) {
+    print_delta(entry.lines, entry.words, entry.chars, 'A', filename);
+  } else if (old->lines != entry.lines || old->words != entry.words || old->chars != entry.chars) {
+    print_delta(entry.lines - old->lines, entry.words - old->words, entry.chars - old->chars, 'M', filename);
+  }
+  if (old != NULL) old->seen = true;
+  if (SNAPSHOT_OUT != NULL) {
+    entry.path = filename;
+    snapshot_add(&NEW_SNAPSHOT, &entry);
+  }
+}
+
+// Reports the files of the old snapshot that were not counted as removed, writes the total change
+// and saves the new snapshot.
+void snapshot_finish() {
+  int i;
+  if (DIFF_AGAINST != NULL) {
+    for (i = 0; i < OLD_SNAPSHOT.capacity; i++) {
+      struct snapshot_entry* e = &OLD_SNAPSHOT.slots[i];
+      if (e->path != NULL && !e->seen) print_delta(-e->lines, -e->words, -e->chars, 'D', e->path);
+    }
+    print_delta(DIFF_LINES, DIFF_WORDS, DIFF_CHARS, '\0', "total");
+  }
+  if (SNAPSHOT_OUT != NULL) snapshot_save(SNAPSHOT_OUT);
+}
+
+/*
+ * Live totals for --watch-tree. The tree is counted once, with an inotify watch on every directory,
+ * and from then on only the files named by inotify events are counted again. The events read
+ * within WATCH_SETTLE milliseconds of each other form one batch: the files they name are collected
+ * in WATCH_BATCH, and each is counted once when the batch ends, however many times it was written.
+ * Counts are kept per file and, for every directory, over its whole subtree: a changed file adds its
+ * change to each directory above it, and a file that is gone is dropped. The tables reuse struct
+ * snapshot, keyed by path, where `seen' marks a directory whose totals changed since they were last
+ * written. When the inotify queue overflows and events are lost, every file is counted again.
+ */
+#define WATCH_SETTLE 100
+#define WATCH_EVENTS (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+char* WATCH_TREE = NULL;
+int WATCH_FD;
+char** WATCH_DIRS = NULL;
+int WATCH_DIRS_CAPACITY = 0;
+struct snapshot WATCH_FILES;
+struct snapshot WATCH_TOTALS;
+struct snapshot WATCH_BATCH;
+
+struct snapshot_entry* watch_entry(struct snapshot* table, char* path) {
+  struct snapshot_entry entry;
+  struct snapshot_entry* slot = table->capacity > 0 ? snapshot_slot(table, path) : NULL;
+  if (slot != NULL && slot->path != NULL) return slot;
+  memset(&entry, 0, sizeof(entry));
+  entry.path = strdup(path);
+  if (entry.path == NULL) exit(EXIT_FAILURE);
+  snapshot_add(table, &entry);
+  return snapshot_slot(table, path);
+}
+
+// Adds a change of counts to every directory from the one holding `path' up to the root.
+void watch_propagate(char* path, int lines, int words, int chars) {
+  char* directory = strdup(path);
+  int root = strlen(WATCH_TREE);
+  if (directory == NULL) exit(EXIT_FAILURE);
+  while (true) {
+    char* slash = strrchr(directory, '/');
+    if (slash == NULL || slash - directory < root) break;
+    *slash = '\0';
+    struct snapshot_entry* total = watch_entry(&WATCH_TOTALS, slash - directory == root ? WATCH_TREE : directory);
+    total->lines += lines;
+    total->words += words;
+    total->chars += chars;
+    total->seen = true;
+    if (slash - directory == root) break;
+  }
+  free(directory);
+}
+
+// Sets the counts of a file, counting it again, or drops it when it is gone or not a regular file
+// anymore.
+void watch_count(char* path, bool ellide_comments) {
+  struct snapshot_entry* entry = watch_entry(&WATCH_FILES, path);
+  struct stat st;
+  int lines = 0, words = 0, chars = 0;
+  FILE* file = NULL;
+  if (lstat(path, &st) == 0 && S_ISREG(st.st_mode)) file = open_input(path, false, NULL);
+  if (file != NULL) count_stream(file, ellide_comments, &lines, &words, &chars);
+  watch_propagate(path, lines - entry->lines, words - entry->words, chars - entry->chars);
+  if (file == NULL) {
+    char* forgotten = entry->path;
+    snapshot_remove(&WATCH_FILES, forgotten);
+    free(forgotten);
+    return;
+  }
+  entry->lines = lines;
+  entry->words = words;
+  entry->chars = chars;
+}
+
+// Watches a directory and counts everything below it.
+void watch_scan(char* directory, bool ellide_comments) {
+  struct dirent* child;
+  int wd = inotify_add_watch(WATCH_FD, directory, WATCH_EVENTS | IN_ONLYDIR);
+  if (wd < 0) exit(EXIT_FAILURE);
+  if (wd >= WATCH_DIRS_CAPACITY) {
+    int capacity = 2 * wd + 64;
+    WATCH_DIRS = realloc(WATCH_DIRS, capacity * sizeof(char*));
+    if (WATCH_DIRS == NULL) exit(EXIT_FAILURE);
+    memset(WATCH_DIRS + WATCH_DIRS_CAPACITY, 0, (capacity - WATCH_DIRS_CAPACITY) * sizeof(char*));
+    WATCH_DIRS_CAPACITY = capacity;
+  }
+  free(WATCH_DIRS[wd]);
+  WATCH_DIRS[wd] = strdup(directory);
+  watch_entry(&WATCH_TOTALS, directory)->seen = true;
+  DIR* dir = opendir(directory);
+  if (dir == NULL) return;
+  while ((child = readdir(dir)) != NULL) {
+    if (strcmp(child->d_name, ".") == 0 || strcmp(child->d_name, "..") == 0) continue;
+    char* path = malloc(strlen(directory) + strlen(child->d_name) + 2);
+    struct stat st;
+    if (path == NULL) exit(EXIT_FAILURE);
+    sprintf(path, "%s/%s", directory, child->d_name);
+    if (lstat(path, &st) != 0) {
+      free(path);
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) watch_scan(path, ellide_comments);
+    else if (S_ISREG(st.st_mode)) watch_count(path, ellide_comments);
+    free(path);
+  }
+  closedir(dir);
+}
+
+// Returns the paths of a table, which stay valid while the table changes, and their number.
+char** watch_paths(struct snapshot* table, int* n) {
+  char** paths = malloc((table->size + 1) * sizeof(char*));
+  int i;
+  if (paths == NULL) exit(EXIT_FAILURE);
+  *n = 0;
+  for (i = 0; i < table->capacity; i++) {
+    if (table->slots[i].path != NULL) paths[(*n)++] = table->slots[i].path;
+  }
+  return paths;
+}
+
+// Forgets every file below a directory that was deleted or moved away, and its watches.
+void watch_forget(char* directory) {
+  int length = strlen(directory);
+  int i, n;
+  char** paths = watch_paths(&WATCH_FILES, &n);
+  for (i = 0; i < n; i++) {
+    if (strncmp(paths[i], directory, length) == 0 && paths[i][length] == '/') {
+      struct snapshot_entry* e = snapshot_slot(&WATCH_FILES, paths[i]);
+      watch_propagate(e->path, -e->lines, -e->words, -e->chars);
+      snapshot_remove(&WATCH_FILES, paths[i]);
+      free(paths[i]);
+    }
+  }
+  free(paths);
+  for (i = 0; i < WATCH_DIRS_CAPACITY; i++) {
+    char* path = WATCH_DIRS[i];
+    if (path != NULL && strncmp(path, directory, length) == 0 && (path[length] == '/' || path[length] == '\0')) {
+      inotify_rm_watch(WATCH_FD, i);
+      free(path);
+      WATCH_DIRS[i] = NULL;
+    }
+  }
+}
+
+int watch_compare(const void* a, const void* b) {
+  return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+// Writes the totals of every directory that changed since the last report, in path order.
+void watch_report() {
+  char** paths = malloc((WATCH_TOTALS.size + 1) * sizeof(char*));
+  int i, n = 0;
+  if (paths == NULL) exit(EXIT_FAILURE);
+  for (i = 0; i < WATCH_TOTALS.capacity; i++) {
+    if (WATCH_TOTALS.slots[i].path != NULL && WATCH_TOTALS.slots[i].seen) paths[n++] = WATCH_TOTALS.slots[i].path;
+  }
+  qsort(paths, n, sizeof(char*), watch_compare);
+  for (i = 0; i < n; i++) {
+    struct snapshot_entry* total = snapshot_slot(&WATCH_TOTALS, paths[i]);
+    if (L) printf("      %d", total->lines);
+    if (W) printf("      %d", total->words);
+    if (C) printf("      %d", total->chars);
+    printf(" %s/\n", paths[i]);
+    total->seen = false;
+  }
+  fflush(stdout);
+  free(paths);
+}
+
+// Counts the files of the batch that just ended, each once.
+void watch_batch(bool ellide_comments) {
+  int i, n;
+  char** paths = watch_paths(&WATCH_BATCH, &n);
+  for (i = 0; i < n; i++) {
+    watch_count(paths[i], ellide_comments);
+    free(paths[i]);
+  }
+  free(paths);
+  if (WATCH_BATCH.capacity > 0) memset(WATCH_BATCH.slots, 0, WATCH_BATCH.capacity * sizeof(struct snapshot_entry));
+  WATCH_BATCH.size = 0;
+}
+
+// Counts every known file again, and scans the tree for the files and directories it does not know,
+// after events were lost.
+void watch_rescan(bool ellide_comments) {
+  int i, n;
+  char** paths = watch_paths(&WATCH_FILES, &n);
+  for (i = 0; i < n; i++) {
+    char* path = strdup(paths[i]);
+    if (path == NULL) exit(EXIT_FAILURE);
+    watch_count(path, ellide_comments);
+    free(path);
+  }
+  free(paths);
+  watch_scan(WATCH_TREE, ellide_comments);
+}
+
+void watch_tree(bool ellide_comments) {
+  static char buffer[65536] __attribute__((aligned(__alignof__(struct inotify_event))));
+  int length = strlen(WATCH_TREE);
+  while (length > 1 && WATCH_TREE[length - 1] == '/') WATCH_TREE[--length] = '\0';
+  WATCH_FD = inotify_init1(IN_CLOEXEC);
+  if (WATCH_FD < 0) exit(EXIT_FAILURE);
+  watch_scan(WATCH_TREE, ellide_comments);
+  watch_report();
+  while (true) {
+    struct pollfd poll_fd = {WATCH_FD, POLLIN, 0};
+    int timeout = -1;
+    bool overflow = false;
+    while (poll(&poll_fd, 1, timeout) > 0) {
+      ssize_t n = read(WATCH_FD, buffer, sizeof(buffer));
+      char* p;
+      if (n <= 0) exit(EXIT_FAILURE);
+      for (p = buffer; p < buffer + n; p += sizeof(struct inotify_event) + ((struct inotify_event*) p)->len) {
+        struct inotify_event* event = (struct inotify_event*) p;
+        if (event->mask & IN_Q_OVERFLOW) overflow = true;
+        if (event->wd < 0 || event->wd >= WATCH_DIRS_CAPACITY || WATCH_DIRS[event->wd] == NULL || event->len == 0)
+          continue;
+        char* path = malloc(strlen(WATCH_DIRS[event->wd]) + strlen(event->name) + 2);
+        if (path == NULL) exit(EXIT_FAILURE);
+        sprintf(path, "%s/%s", WATCH_DIRS[event->wd], event->name);
+        if (event->mask & IN_ISDIR) {
+          if (event->mask & (IN_DELETE | IN_MOVED_FROM)) watch_forget(path);
+          if (event->mask & (IN_CREATE | IN_MOVED_TO)) watch_scan(path, ellide_comments);
+        } else {
+          watch_entry(&WATCH_BATCH, path);
+        }
+        free(path);
+      }
+      timeout = WATCH_SETTLE;
+    }
+    watch_batch(ellide_comments);
+    if (overflow) watch_rescan(ellide_comments);
+    watch_report();
+  }
+}
+
+/*
+ * The io_uring engine for --engine=uring, for trees of small files where the four system calls to
+ * open, stat, read and close a file cost more than counting it. Each file gets a chain of four
+ * linked requests: openat into a registered file slot, statx, a read of up to URING_BUFFER bytes into
+ * the file's own buffer, and close of the slot. URING_BATCH chains are submitted with one system
+ * call, and each file is counted from its buffer as the batch completes, in operand order. The links
+ * are hard links, so a short read, which is the normal case here, still closes the slot. A file
+ * that does not fit its buffer, or fails to open, is counted by wc() instead. Without io_uring
+ * support in the kernel, every file is.
+ */
+#define URING_BATCH 64
+#define URING_BUFFER 65536
+#define URING_OPEN 0
+#define URING_STATX 1
+#define URING_READ 2
+#define URING_CLOSE 3
+
+struct uring {
+  int fd;
+  unsigned int* sq_head;
+  unsigned int* sq_tail;
+  unsigned int* sq_mask;
+  unsigned int* sq_array;
+  struct io_uring_sqe* sqes;
+  unsigned int* cq_head;
+  unsigned int* cq_tail;
+  unsigned int* cq_mask;
+  struct io_uring_cqe* cqes;
+};
+
+struct uring_file {
+  char* path;
+  struct statx stat;
+  int opened;
+  int read;
+  unsigned char* buffer;
+};
+
+int ENGINE_URING = 0;
+struct uring URING;
+bool URING_READY = false;
+
+bool uring_setup() {
+  struct io_uring_params params;
+  int files[URING_BATCH];
+  int i;
+  memset(&params, 0, sizeof(params));
+  URING.fd = syscall(__NR_io_uring_setup, 4 * URING_BATCH, &params);
+  if (URING.fd < 0) return false;
+  size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+  char* sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, URING.fd, IORING_OFF_SQ_RING);
+  char* cq = sq;
+  if (sq == MAP_FAILED) return false;
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+    cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, URING.fd, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED) return false;
+  }
+  URING.sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, URING.fd, IORING_OFF_SQES);
+  if (URING.sqes == MAP_FAILED) return false;
+  URING.sq_head = (unsigned int*) (sq + params.sq_off.head);
+  URING.sq_tail = (unsigned int*) (sq + params.sq_off.tail);
+  URING.sq_mask = (unsigned int*) (sq + params.sq_off.ring_mask);
+  URING.sq_array = (unsigned int*) (sq + params.sq_off.array);
+  URING.cq_head = (unsigned int*) (cq + params.cq_off.head);
+  URING.cq_tail = (unsigned int*) (cq + params.cq_off.tail);
+  URING.cq_mask = (unsigned int*) (cq + params.cq_off.ring_mask);
+  URING.cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+  // Empty slots for the files opened by the chains.
+  for (i = 0; i < URING_BATCH; i++) files[i] = -1;
+  return syscall(__NR_io_uring_register, URING.fd, IORING_REGISTER_FILES, files, URING_BATCH) == 0;
+}
+
+struct io_uring_sqe* uring_sqe(int op, int slot, unsigned char flags) {
+  unsigned int tail = *URING.sq_tail;
+  unsigned int index = tail & *URING.sq_mask;
+  struct io_uring_sqe* sqe = &URING.sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->flags = flags;
+  sqe->user_data = (unsigned long long) slot * 4 + op;
+  URING.sq_array[index] = index;
+  __atomic_store_n(URING.sq_tail, tail + 1, __ATOMIC_RELEASE);
+  return sqe;
+}
+
+// Submits the chains of a batch and waits until all four requests of every chain complete.
+void uring_run(struct uring_file* files, int n) {
+  int i;
+  for (i = 0; i < n; i++) {
+    struct io_uring_sqe* sqe = uring_sqe(URING_OPEN, i, IOSQE_IO_HARDLINK);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long long) files[i].path;
+    sqe->open_flags = O_RDONLY;
+    sqe->file_index = i + 1;
+    sqe = uring_sqe(URING_STATX, i, IOSQE_IO_HARDLINK);
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long long) files[i].path;
+    sqe->len = STATX_SIZE;
+    sqe->off = (unsigned long long) &files[i].stat;
+    sqe = uring_sqe(URING_READ, i, IOSQE_IO_HARDLINK | IOSQE_FIXED_FILE);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = i;
+    sqe->addr = (unsigned long long) files[i].buffer;
+    sqe->len = URING_BUFFER;
+    if (IO_PRIORITY >= 0) sqe->ioprio = IO_PRIORITY;
+    sqe = uring_sqe(URING_CLOSE, i, 0);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = i + 1;
+  }
+  int pending = 4 * n;
+  int submit = pending;
+  long long start = trace_start(), bytes = 0;
+  long long probe = PROBE_ENABLED(chunk_end) ? now_ns() : 0;
+  if (PROBE_ENABLED(chunk_start)) PROBE1(chunk_start, (long long) n * URING_BUFFER);
+  while (pending > 0) {
+    int entered = syscall(__NR_io_uring_enter, URING.fd, submit, pending, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (entered < 0) exit(EXIT_FAILURE);
+    submit -= entered;
+    unsigned int head = *URING.cq_head;
+    while (head != __atomic_load_n(URING.cq_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe* cqe = &URING.cqes[head & *URING.cq_mask];
+      struct uring_file* file = &files[cqe->user_data / 4];
+      if (cqe->user_data % 4 == URING_OPEN) file->opened = cqe->res;
+      if (cqe->user_data % 4 == URING_READ) file->read = cqe->res;
+      if (cqe->user_data % 4 == URING_READ && IO_LIMIT > 0 && cqe->res > 0) IO_TOKENS -= cqe->res;
+      if (cqe->user_data % 4 == URING_READ && cqe->res > 0) bytes += cqe->res;
+      head++;
+      pending--;
+    }
+    __atomic_store_n(URING.cq_head, head, __ATOMIC_RELEASE);
+  }
+  if (PROBE_ENABLED(chunk_end)) PROBE2(chunk_end, bytes, now_ns() - probe);
+  trace_span("uring", start, NULL, bytes);
+}
+
+// Counts the file operands with the io_uring engine and writes their counts like wc() would.
+void uring_count(char** paths, int n, bool ellide_comments) {
+  static struct uring_file files[URING_BATCH];
+  int first, i;
+  if (!URING_READY) URING_READY = uring_setup();
+  for (i = 0; i < URING_BATCH && files[i].buffer == NULL; i++) {
+    files[i].buffer = malloc(URING_BUFFER);
+    if (files[i].buffer == NULL) exit(EXIT_FAILURE);
+  }
+  for (first = 0; first < n; first += URING_BATCH) {
+    int batch = n - first < URING_BATCH ? n - first : URING_BATCH;
+    for (i = 0; i < batch; i++) {
+      files[i].path = paths[first + i];
+      files[i].opened = files[i].read = -1;
+      memset(&files[i].stat, 0, sizeof(struct statx));
+    }
+    // With --io-limit, the bytes a batch read are taken from the bucket afterwards, since the
+    // size of a file is not known before it is read, and the next batch waits for the debt.
+    if (IO_LIMIT > 0) io_throttle(0);
+    if (URING_READY) uring_run(files, batch);
+    for (i = 0; i < batch; i++) {
+      struct uring_file* file = &files[i];
+      if (file->opened < 0 || file->read < 0 || file->stat.stx_size > (unsigned long long) file->read) {
+        if (ellide_comments) exclude_comments(file->path);
+        wc(file->path);
+      } else {
+        int lines, words, chars;
+        long long start = trace_start();
+        FILE* stream = fmemopen(file->buffer, file->read, "r");
+        if (stream == NULL) exit(EXIT_FAILURE);
+        if (ellide_comments) exclude_comments_stream(stream);
+        rewind(stream);
+        wc_stream(stream, &lines, &words, &chars);
+        fclose(stream);
+        trace_span("count", start, file->path, file->read);
+        print_counts(lines, words, chars);
+        if (HASH) {
+          hash_init();
+          hash_update(file->buffer, file->read);
+          print_hash();
+        }
+      }
+      printf(" %s\n", file->path);
+      report(false);
+    }
+  }
+}
+
+/*
+ * Automatic tuning for --tune=auto. The usable CPUs are the smaller of the affinity mask and the
+ * quota in the cgroup's cpu.max. Then two things are measured on the first operands: the stdio
+ * buffer size that reads the first TUNE_SAMPLE bytes of the first file fastest, and whether the
+ * io_uring engine opens and reads the first batch of files faster than stdio does. Every sample is
+ * read once before it is timed, so that both sides are measured from the page cache. The result is
+ * kept in TUNE_CACHE under $HOME, one line "device cpus buffer engine" per device and CPU count,
+ * and later runs on the same device take it from there without measuring.
+ */
+#define TUNE_SAMPLE (8 << 20)
+#define TUNE_CACHE ".cache/mywc-tune"
+
+bool TUNE = false;
+
+int usable_cpus() {
+  cpu_set_t set;
+  int cpus = 1;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) cpus = CPU_COUNT(&set);
+  FILE* file = fopen("/sys/fs/cgroup/cpu.max", "r");
+  if (file != NULL) {
+    char quota[32];
+    long period;
+    if (fscanf(file, "%31s %ld", quota, &period) == 2 && strcmp(quota, "max") != 0 && period > 0) {
+      int limit = (atol(quota) + period - 1) / period;
+      if (limit >= 1 && limit < cpus) cpus = limit;
+    }
+    fclose(file);
+  }
+  return cpus;
+}
+
+double tune_buffer_time(int fd, char* buffer, int size, off_t sample) {
+  struct timespec start;
+  off_t offset;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (offset = 0; offset < sample; offset += size)
+    if (pread(fd, buffer, size, offset) <= 0) break;
+  return seconds_since(&start);
+}
+
+// Returns the buffer size from 4 KiB to 1 MiB that reads the start of `path' fastest, or 0 when the
+// file is too small to tell.
+int tune_buffer(char* path) {
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+  int best = 0, size;
+  double best_time = 0;
+  if (fd < 0) return 0;
+  if (fstat(fd, &st) != 0 || st.st_size < 4 * (1 << 20)) {
+    close(fd);
+    return 0;
+  }
+  off_t sample = st.st_size < TUNE_SAMPLE ? st.st_size : TUNE_SAMPLE;
+  char* buffer = malloc(1 << 20);
+  if (buffer == NULL) exit(EXIT_FAILURE);
+  tune_buffer_time(fd, buffer, 1 << 20, sample);
+  for (size = 1 << 12; size <= 1 << 20; size <<= 2) {
+    double time = tune_buffer_time(fd, buffer, size, sample);
+    if (best == 0 || time < best_time) {
+      best = size;
+      best_time = time;
+    }
+  }
+  free(buffer);
+  close(fd);
+  return best;
+}
+
+double tune_stdio_time(char** paths, int n, char* buffer) {
+  struct timespec start;
+  int i;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < n; i++) {
+    FILE* file = fopen(paths[i], "rb");
+    if (file == NULL) continue;
+    while (fread(buffer, 1, URING_BUFFER, file) == URING_BUFFER);
+    fclose(file);
+  }
+  return seconds_since(&start);
+}
+
+double tune_uring_time(struct uring_file* files, int n) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  uring_run(files, n);
+  return seconds_since(&start);
+}
+
+// Returns whether io_uring reads the first batch of `paths' faster than stdio. Only worth asking
+// when there is more than one batch.
+bool tune_engine(char** paths, int n) {
+  struct uring_file files[URING_BATCH];
+  int i;
+  if (n < 2 * URING_BATCH) return false;
+  if (!URING_READY) URING_READY = uring_setup();
+  if (!URING_READY) return false;
+  char* buffer = malloc((URING_BATCH + 1) * URING_BUFFER);
+  if (buffer == NULL) exit(EXIT_FAILURE);
+  for (i = 0; i < URING_BATCH; i++) {
+    files[i].path = paths[i];
+    files[i].buffer = (unsigned char*) buffer + (i + 1) * URING_BUFFER;
+  }
+  tune_stdio_time(paths, URING_BATCH, buffer);
+  double stdio = tune_stdio_time(paths, URING_BATCH, buffer);
+  double uring = tune_uring_time(files, URING_BATCH);
+  free(buffer);
+  return uring < stdio;
+}
+
+// Sets INPUT_BUFFER and ENGINE_URING for the file operands, from the cache when it has the device.
+void tune(char** paths, int n) {
+  struct stat st;
+  char cache[PATH_MAX];
+  unsigned long device;
+  int cpus = usable_cpus(), cached_cpus, buffer, engine;
+  if (n == 0 || stat(paths[0], &st) != 0 || getenv("HOME") == NULL) return;
+  snprintf(cache, sizeof(cache), "%s/%s", getenv("HOME"), TUNE_CACHE);
+  FILE* file = fopen(cache, "r");
+  if (file != NULL) {
+    while (fscanf(file, "%lu %d %d %d", &device, &cached_cpus, &buffer, &engine) == 4) {
+      if (device == st.st_dev && cached_cpus == cpus) {
+        INPUT_BUFFER = buffer;
+        ENGINE_URING = engine;
+        fclose(file);
+        return;
+      }
+    }
+    fclose(file);
+  }
+  INPUT_BUFFER = tune_buffer(paths[0]);
+  ENGINE_URING = tune_engine(paths, n);
+  // Only a measured buffer size is worth keeping; small files say nothing about the device.
+  if (INPUT_BUFFER == 0 && n < 2 * URING_BATCH) return;
+  file = fopen(cache, "a");
+  if (file == NULL) return;
+  fprintf(file, "%lu %d %d %d\n", (unsigned long) st.st_dev, cpus, INPUT_BUFFER, ENGINE_URING);
+  fclose(file);
+}
+
+/*
+ * Threshold queries for --at-least and --at-most. The files are read with read() in large buffers
+ * and only the one count that is asked about is kept: lines are found with memchr(), and characters
+ * of a regular file come from its size without reading it at all. As soon as the total settles the
+ * question, mywc exits with status 0 when the total is in range and 1 when it is not, and reads no
+ * further. A file that cannot be read exits with THRESHOLD_ERROR, so that it is not taken for a no.
+ * Nothing is written, and -C and the other modes do not apply.
+ */
+#define THRESHOLD_BUFFER (1 << 20)
+#define THRESHOLD_ERROR 2
+
+long long AT_LEAST = -1;
+long long AT_MOST = -1;
+long long THRESHOLD_TOTAL = 0;
+
+// Exits when the total so far answers the query: above --at-most is a no, and reaching --at-least
+// is a yes when there is no --at-most.
+void threshold_check() {
+  if (AT_MOST >= 0 && THRESHOLD_TOTAL > AT_MOST) exit(1);
+  if (AT_MOST < 0 && THRESHOLD_TOTAL >= AT_LEAST) exit(0);
+}
+
+void threshold_fd(int fd) {
+  static char* buffer = NULL;
+  struct stat st;
+  bool in_word = false;
+  ssize_t n;
+  if (C && !L && !W && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    THRESHOLD_TOTAL += st.st_size;
+    threshold_check();
+    return;
+  }
+  if (buffer == NULL && (buffer = malloc(THRESHOLD_BUFFER)) == NULL) exit(THRESHOLD_ERROR);
+  while ((n = read(fd, buffer, THRESHOLD_BUFFER)) > 0) {
+    if (C && !L && !W) {
+      THRESHOLD_TOTAL += n;
+    } else if (W && !L && !C) {
+      ssize_t i;
+      for (i = 0; i < n; i++) {
+        bool space = BYTE_CLASS[(unsigned char) buffer[i]] & CLASS_SPACE;
+        THRESHOLD_TOTAL += !space && !in_word;
+        in_word = !space;
+      }
+    } else {
+      const char* p = buffer;
+      const char* end = buffer + n;
+      while ((p = memchr(p, '\n', end - p)) != NULL) {
+        THRESHOLD_TOTAL++;
+        p++;
+      }
+    }
+    threshold_check();
+  }
+  if (n < 0) exit(THRESHOLD_ERROR);
+}
+
+void threshold_file(const char* filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) exit(THRESHOLD_ERROR);
+  threshold_fd(fd);
+  close(fd);
+}
+
+// Takes --at-least=N and --at-most=N before the other arguments, so that they apply to every file
+// operand wherever they are given.
+void threshold_option(const char* arg) {
+  char* end;
+  long long n;
+  if (strncmp(arg, "--at-least=", 11) != 0 && strncmp(arg, "--at-most=", 10) != 0) return;
+  n = strtoll(strchr(arg, '=') + 1, &end, 10);
+  if (n < 0 || *end != '\0' || end == strchr(arg, '=') + 1) exit(THRESHOLD_ERROR);
+  if (arg[5] == 'l') AT_LEAST = n;
+  else AT_MOST = n;
+}
+
+int main(int argc, char* argv[], char* env[]) {
+  int i;
+  if (argc == 1 || (argc > 1 && (argv[1][0] != '-' || strcmp(argv[1], "-C") == 0 ||
+                                   strncmp(argv[1], "--", 2) == 0))) W = L = C = true;
+  bool ellide_comments = false;
+  bool repo_given = false;
+  int numfiles = 0;
+  char** uring_paths = malloc(argc * sizeof(char*));
+  if (uring_paths == NULL) exit(EXIT_FAILURE);
+  for (i = 1; i < argc; i++) threshold_option(argv[i]);
+  for (i = 1; i < argc; i++) {
+    int j;
+    char* arg = argv[i];
+    // The other modes do not apply to a threshold query, and their options are not even checked.
+    if (strncmp(arg, "--", 2) == 0 && (AT_LEAST >= 0 || AT_MOST >= 0)) continue;
+    if (strncmp(arg, "--", 2) == 0) {
+      if (strncmp(arg, "--top-lines=", 12) == 0) {
+        TOP_LINES = atoi(arg + 12);
+        if (TOP_LINES <= 0) exit(EXIT_FAILURE);
+        topk_init(&FILE_TOPK);
+        topk_init(&TOTAL_TOPK);
+      } else if (strncmp(arg, "--match=", 8) == 0) {
+        regex_compile(arg + 8);
+      } else if (strncmp(arg, "--bucket-by=", 12) == 0) {
+        time_t now = time(NULL);
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        SYSLOG_YEAR = tm.tm_year + 1900;
+        if (strcmp(arg + 12, "iso8601") == 0) BUCKET_FORMAT = BUCKET_ISO8601;
+        else if (strcmp(arg + 12, "epoch") == 0) BUCKET_FORMAT = BUCKET_EPOCH;
+        else if (strcmp(arg + 12, "syslog") == 0) BUCKET_FORMAT = BUCKET_SYSLOG;
+        else exit(EXIT_FAILURE);
+        buckets_init(&FILE_BUCKETS);
+        buckets_init(&TOTAL_BUCKETS);
+      } else if (strcmp(arg, "--jsonl") == 0 || strcmp(arg, "--jsonl=keys") == 0) {
+        JSONL = true;
+        JSONL_KEYS = JSONL_KEYS || strcmp(arg, "--jsonl=keys") == 0;
+        json_keys_init(&FILE_KEYS);
+        json_keys_init(&TOTAL_KEYS);
+      } else if (strncmp(arg, "--eol=", 6) == 0) {
+        if (strcmp(arg + 6, "lf") == 0) EOL = EOL_LF;
+        else if (strcmp(arg + 6, "crlf") == 0) EOL = EOL_CRLF;
+        else if (strcmp(arg + 6, "cr") == 0) EOL = EOL_CR;
+        else if (strcmp(arg + 6, "any") == 0) EOL = EOL_ANY;
+        else exit(EXIT_FAILURE);
+      } else if (strncmp(arg, "--git-rev=", 10) == 0) {
+        GIT_REV = arg + 10;
+      } else if (strncmp(arg, "--snapshot=", 11) == 0) {
+        SNAPSHOT_OUT = arg + 11;
+      } else if (strncmp(arg, "--diff-against=", 15) == 0) {
+        DIFF_AGAINST = arg + 15;
+        snapshot_load(DIFF_AGAINST);
+      } else if (strncmp(arg, "--watch-tree=", 13) == 0) {
+        WATCH_TREE = arg + 13;
+      } else if (strcmp(arg, "--engine=uring") == 0 || strcmp(arg, "--engine=stdio") == 0) {
+        ENGINE_URING = strcmp(arg, "--engine=uring") == 0;
+      } else if (strcmp(arg, "--hash=xxh3") == 0 || strcmp(arg, "--hash=blake3") == 0) {
+        HASH = strcmp(arg, "--hash=xxh3") == 0 ? HASH_XXH3 : HASH_BLAKE3;
+      } else if (strncmp(arg, "--boundaries=", 13) == 0) {
+        BOUNDARY_OUT = fopen(arg + 13, "wb");
+        if (BOUNDARY_OUT == NULL) exit(EXIT_FAILURE);
+        BOUNDARIES.emit = boundary_write;
+        BOUNDARIES.context = BOUNDARY_OUT;
+      } else if (strcmp(arg, "--boundary-format=varint") == 0) {
+        BOUNDARIES.format = BOUNDARY_VARINT;
+      } else if (strcmp(arg, "--boundary-format=fixed") == 0) {
+        BOUNDARIES.format = BOUNDARY_FIXED;
+      } else if (strcmp(arg, "--per-line") == 0 || strcmp(arg, "--per-line=counts") == 0) {
+        PER_LINE = PER_LINE_COUNTS;
+      } else if (strcmp(arg, "--per-line=histogram") == 0) {
+        PER_LINE = PER_LINE_HISTOGRAM;
+      } else if (strncmp(arg, "--per-line=", 11) == 0) {
+        PER_LINE = PER_LINE_EXPECT;
+        PER_LINE_FIELDS = atoi(arg + 11);
+        if (PER_LINE_FIELDS < 0 || arg[11] < '0' || arg[11] > '9') exit(EXIT_FAILURE);
+      } else if (strcmp(arg, "--prose") == 0) {
+        PROSE = true;
+      } else if (strncmp(arg, "--tokens=", 9) == 0) {
+        TOKENS = true;
+        vocab_load(arg + 9);
+      } else if (strcmp(arg, "--code-stats") == 0) {
+        CODE_STATS = true;
+      } else if (strncmp(arg, "--trace=", 8) == 0) {
+        TRACE_FILE = arg + 8;
+        atexit(trace_dump);
+      } else if (strncmp(arg, "--exclude-words=", 16) == 0 || strncmp(arg, "--only-words=", 13) == 0) {
+        WORD_FILTER = arg[2] == 'e' ? FILTER_EXCLUDE : FILTER_ONLY;
+        word_set_load(&WORD_SET, strchr(arg, '=') + 1);
+      } else if (strcmp(arg, "--graphemes") == 0) {
+        GRAPHEMES = true;
+      } else if (strcmp(arg, "--max-width") == 0) {
+        MAX_WIDTH = true;
+      } else if (strncmp(arg, "--max-width=", 12) == 0) {
+        MAX_WIDTH = true;
+        WIDTH_LIMIT = atoi(arg + 12);
+        if (WIDTH_LIMIT < 0 || arg[12] < '0' || arg[12] > '9') exit(EXIT_FAILURE);
+      } else if (strcmp(arg, "--tune=auto") == 0) {
+        TUNE = true;
+      } else if (strncmp(arg, "--io-limit=", 11) == 0) {
+        IO_LIMIT = atof(arg + 11) * 1e6;
+        if (IO_LIMIT <= 0) exit(EXIT_FAILURE);
+        clock_gettime(CLOCK_MONOTONIC, &IO_REFILLED);
+      } else if (strncmp(arg, "--ionice=", 9) == 0) {
+        set_io_priority(arg + 9);
+      } else if (strncmp(arg, "--bucket-width=", 15) == 0) {
+        BUCKET_WIDTH = atoll(arg + 15);
+        if (BUCKET_WIDTH <= 0) exit(EXIT_FAILURE);
+      }
+    } else if (arg[0] == '-') {
+      for (j = 1; j < strlen(arg); j++) {
+        if (arg[j] == 'C') ellide_comments = true;
+        else if (arg[j] == 'w') W = true;
+        else if (arg[j] == 'l') L = true;
+        else if (arg[j] == 'c') C = true;
+      }
+    } else if (ellide_comments && (MATCH || WORD_FILTER)) {
+      exit(EXIT_FAILURE);
+    } else if (AT_LEAST >= 0 || AT_MOST >= 0) {
+      uring_paths[numfiles++] = arg;
+    } else if (GIT_REV) {
+      numfiles += git_count(arg, ellide_comments);
+      repo_given = true;
+    } else if ((SNAPSHOT_OUT || DIFF_AGAINST) && !ENGINE_URING && !TUNE) {
+      numfiles++;
+      snapshot_file(arg, ellide_comments);
+    } else if (ENGINE_URING || TUNE) {
+      uring_paths[numfiles++] = arg;
+    } else {
+      numfiles++;
+      if (ellide_comments) exclude_comments(arg);
+      wc(arg);
+      printf(" %s\n", arg);
+      report(false);
+    }
+  }
+
+  // The comments of -C are taken off the counts of whole files, which these modes count in part.
+  if (ellide_comments && (MATCH || WORD_FILTER)) exit(EXIT_FAILURE);
+  if (AT_LEAST >= 0 || AT_MOST >= 0) {
+    for (i = 0; i < numfiles; i++) threshold_file(uring_paths[i]);
+    if (numfiles == 0) threshold_fd(STDIN_FILENO);
+    exit(THRESHOLD_TOTAL >= AT_LEAST ? 0 : 1);
+  }
+  if (GIT_REV && !repo_given) numfiles += git_count(".", ellide_comments);
+  if (WATCH_TREE) watch_tree(ellide_comments);
+  // The io_uring engine does not record snapshots, so it cannot be asked for with them. A snapshot
+  // run with --tune=auto keeps the tuned buffer size and reads its files with stdio.
+  if (ENGINE_URING && (SNAPSHOT_OUT || DIFF_AGAINST)) exit(EXIT_FAILURE);
+  if (TUNE && !ENGINE_URING) tune(uring_paths, numfiles);
+  if (TUNE && (SNAPSHOT_OUT || DIFF_AGAINST)) {
+    for (i = 0; i < numfiles; i++) snapshot_file(uring_paths[i], ellide_comments);
+  } else if (ENGINE_URING) uring_count(uring_paths, numfiles, ellide_comments);
+  else if (TUNE) {
+    for (i = 0; i < numfiles; i++) {
+      if (ellide_comments) exclude_comments(uring_paths[i]);
+      wc(uring_paths[i]);
+      printf(" %s\n", uring_paths[i]);
+      report(false);
+    }
+  }
+
+  if (SNAPSHOT_OUT || DIFF_AGAINST) snapshot_finish();
+
+  if (numfiles > 1 && !DIFF_AGAINST) {
+    printf("      %d      %d      %d total\n", TOTAL_LINES, TOTAL_WORDS, TOTAL_CHARS);
+    report(true);
+  }
 
-  if (numfiles == 0) {
+  if (numfiles == 0 && !GIT_REV && !DIFF_AGAINST) {
     char* filename = "temp.txt";
     FILE* file = fopen(filename, "wb");
     // Some of the code below is taken from stackoverflow, credit to user: user411313
@@ -253,6 +5352,7 @@ int main(int argc, char* argv[], char* env[]) {
     if (ellide_comments) exclude_comments(filename);
     wc(filename);
     printf("\n");
+    report(false);
 
     remove(filename);
   }
@@ -0,0 +1,21 @@
+# Run from this directory after ``gcc -o ../mywc ../mywc.c''. Counts each file as a file and through a
+# pipe, which cannot be rewound, and prints the differences, if any.
+mywc=$(pwd)/../mywc
+dir=$(mktemp -d)
+printf 'hello world foo\n' > "$dir/plain.txt"
+printf '\377ab c\n' > "$dir/mark.txt"
+printf '\376\377\000a\000 \000b\000\n' > "$dir/utf16be.txt"
+printf '\377\376a\000 \000b\000\n\000' > "$dir/utf16le.txt"
+printf 'ab cd\nthe cat sat\n\nno newline' > "$dir/lines.txt"
+for file in "$dir"/*.txt
+  do
+    for mode in "" "--graphemes" "--max-width" "--per-line" "--graphemes --match=a" "--per-line --prose"
+      do
+        diff <("$mywc" $mode "$file" | sed "s#$file##") <("$mywc" $mode <(cat "$file") | sed "s#/dev/fd/[0-9]*##") ||
+          echo "$mode $(basename "$file") differs through a pipe"
+      done
+    "$mywc" --boundaries="$dir/file.b" "$file" > /dev/null
+    "$mywc" --boundaries="$dir/pipe.b" <(cat "$file") > /dev/null
+    cmp -s "$dir/file.b" "$dir/pipe.b" || echo "boundaries of $(basename "$file") differ through a pipe"
+  done
+rm -rf "$dir"
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+#
+# Writes unicode_tables.h, the Unicode property tables of mywc, to standard output:
+#   python3 unicode_tables.py > unicode_tables.h
+#
+# The properties are taken from the Python regex module, so the tables follow its Unicode version.
+# Each table is split in two stages: GRAPHEME_STAGE1[cp >> GRAPHEME_SHIFT] picks a block of
+# GRAPHEME_STAGE2, and identical blocks are stored once. WIDTH_STAGE1 and WIDTH_STAGE2 are split the
+# same way.
+
+import regex
+import sys
+
+GCB = ["Other", "CR", "LF", "Control", "Extend", "ZWJ", "Regional_Indicator", "Prepend", "SpacingMark",
+       "L", "V", "T", "LV", "LVT"]
+INCB = ["None", "Linker", "Consonant", "Extend"]
+SHIFT = 7
+LIMIT = 0x110000
+
+
+def ranges(pattern):
+    """Returns the code points matching a property pattern, as a set."""
+    text = "".join(chr(cp) for cp in range(LIMIT) if not 0xD800 <= cp < 0xE000)
+    found = set()
+    for match in regex.finditer(pattern + "+", text):
+        found.update(ord(c) for c in match.group())
+    return found
+
+
+def two_stage(values, shift):
+    size = 1 << shift
+    blocks, stage1, stage2 = {}, [], []
+    for start in range(0, LIMIT, size):
+        block = tuple(values[start:start + size])
+        if block not in blocks:
+            blocks[block] = len(blocks)
+            stage2.extend(block)
+        stage1.append(blocks[block])
+    return stage1, stage2
+
+
+def write_array(out, ctype, name, values, per_line=24):
+    out.write("static const %s %s[%d] = {\n" % (ctype, name, len(values)))
+    for i in range(0, len(values), per_line):
+        out.write("  " + ", ".join(str(v) for v in values[i:i + per_line]) + ",\n")
+    out.write("};\n\n")
+
+
+def widths():
+    """Returns the display width of every code point, as wcwidth() gives it, with 0 for controls."""
+    values = [1] * LIMIT
+    for pattern in (r"\p{East_Asian_Width=Wide}", r"\p{East_Asian_Width=Fullwidth}"):
+        for cp in ranges(pattern):
+            values[cp] = 2
+    for pattern in (r"\p{General_Category=Mn}", r"\p{General_Category=Me}", r"\p{General_Category=Cf}",
+                    r"\p{General_Category=Cc}", r"\p{Hangul_Syllable_Type=V}", r"\p{Hangul_Syllable_Type=T}"):
+        for cp in ranges(pattern):
+            values[cp] = 0
+    values[0x00AD] = 1
+    values[0x200B] = 0
+    return values
+
+
+def main():
+    values = [0] * LIMIT
+    for index, name in enumerate(GCB[1:], 1):
+        for cp in ranges(r"\p{Grapheme_Cluster_Break=%s}" % name):
+            values[cp] = index
+    for cp in ranges(r"\p{Extended_Pictographic}"):
+        values[cp] |= 0x10
+    for index, name in enumerate(INCB[1:], 1):
+        for cp in ranges(r"\p{InCB=%s}" % name):
+            values[cp] |= index << 5
+    stage1, stage2 = two_stage(values, SHIFT)
+    out = sys.stdout
+    out.write("/* Generated by unicode_tables.py with the Python regex module %s. */\n\n" % regex.__version__)
+    out.write("/*\n * Grapheme properties: bits 0-3 are the Grapheme_Cluster_Break value, bit 4 is\n"
+              " * Extended_Pictographic, and bits 5-6 the Indic_Conjunct_Break value.\n */\n")
+    out.write("#define GRAPHEME_SHIFT %d\n\n" % SHIFT)
+    for index, name in enumerate(GCB):
+        out.write("#define GCB_%s %d\n" % (name.upper(), index))
+    out.write("#define GCB_PICTOGRAPHIC 0x10\n")
+    for index, name in enumerate(INCB[1:], 1):
+        out.write("#define INCB_%s %d\n" % (name.upper(), index))
+    out.write("\n")
+    write_array(out, "unsigned short" if len(stage2) >> SHIFT > 255 else "unsigned char", "GRAPHEME_STAGE1", stage1)
+    write_array(out, "unsigned char", "GRAPHEME_STAGE2", stage2)
+    stage1, stage2 = two_stage(widths(), SHIFT)
+    stage2 = [sum(stage2[i + j] << 2 * j for j in range(4)) for i in range(0, len(stage2), 4)]
+    out.write("/*\n * Display widths in columns, four to a byte with the first in the low bits: 0 for combining marks,\n"
+              " * format and control characters, 2 for wide and fullwidth East Asian characters, and 1 for the\n"
+              " * others.\n */\n")
+    out.write("#define WIDTH_SHIFT %d\n\n" % SHIFT)
+    write_array(out, "unsigned short" if len(stage2) >> SHIFT > 255 else "unsigned char", "WIDTH_STAGE1", stage1)
+    write_array(out, "unsigned char", "WIDTH_STAGE2", stage2)
+
+
+if __name__ == "__main__":
+    main()
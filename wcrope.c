@@ -0,0 +1,308 @@
+#include "wcrope.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The summary of a part of the text. A word that crosses from one part to the next is counted in
+ * both, so joining two parts takes it off once when the first ends and the second starts in a word.
+ */
+struct summary {
+  size_t lines;
+  size_t words;
+  size_t chars;
+  bool first_space;
+  bool last_space;
+};
+
+struct node {
+  struct node* left;
+  struct node* right;
+  unsigned int priority;
+  struct summary own;
+  struct summary sum;
+  size_t length;
+  char text[WCROPE_CHUNK];
+};
+
+// Nodes are taken from `spare', which is filled before the tree changes, so that running out of
+// memory leaves the text as it was.
+struct wcrope {
+  struct node* root;
+  struct node* spare;
+  unsigned int seed;
+};
+
+static const unsigned char SPACE[256] = {
+  ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1, [' '] = 1,
+};
+
+static const struct summary EMPTY = {0, 0, 0, true, true};
+
+static struct summary join(struct summary a, struct summary b) {
+  struct summary s;
+  if (a.chars == 0) return b;
+  if (b.chars == 0) return a;
+  s.lines = a.lines + b.lines;
+  s.words = a.words + b.words - (!a.last_space && !b.first_space);
+  s.chars = a.chars + b.chars;
+  s.first_space = a.first_space;
+  s.last_space = b.last_space;
+  return s;
+}
+
+static struct summary sum(const struct node* n) {
+  return n == NULL ? EMPTY : n->sum;
+}
+
+// Counts the chunk of a node, for a new chunk or one an edit changed.
+static void count(struct node* n) {
+  const unsigned char* p = (const unsigned char*) n->text;
+  size_t lines = 0, words = 0, i;
+  unsigned int space = 1;
+  for (i = 0; i < n->length; i++) {
+    unsigned int next = SPACE[p[i]];
+    lines += p[i] == '\n';
+    words += space & ~next;
+    space = next;
+  }
+  n->own.lines = lines;
+  n->own.words = words;
+  n->own.chars = n->length;
+  n->own.first_space = n->length == 0 || SPACE[p[0]];
+  n->own.last_space = space;
+}
+
+static void update(struct node* n) {
+  n->sum = join(join(sum(n->left), n->own), sum(n->right));
+}
+
+static int reserve(struct wcrope* rope, size_t nodes) {
+  struct node* n;
+  size_t have = 0;
+  for (n = rope->spare; n != NULL && have < nodes; n = n->left) have++;
+  while (have < nodes) {
+    n = malloc(sizeof(struct node));
+    if (n == NULL) return -1;
+    n->left = rope->spare;
+    rope->spare = n;
+    have++;
+  }
+  return 0;
+}
+
+static struct node* take(struct wcrope* rope) {
+  struct node* n = rope->spare;
+  rope->spare = n->left;
+  n->left = n->right = NULL;
+  n->length = 0;
+  // xorshift32 for the priorities, which keep the treap balanced whatever the order of the edits.
+  rope->seed ^= rope->seed << 13;
+  rope->seed ^= rope->seed >> 17;
+  rope->seed ^= rope->seed << 5;
+  n->priority = rope->seed;
+  return n;
+}
+
+static void free_tree(struct node* n) {
+  if (n == NULL) return;
+  free_tree(n->left);
+  free_tree(n->right);
+  free(n);
+}
+
+static struct node* merge(struct node* a, struct node* b) {
+  if (a == NULL) return b;
+  if (b == NULL) return a;
+  if (a->priority > b->priority) {
+    a->right = merge(a->right, b);
+    update(a);
+    return a;
+  }
+  b->left = merge(a, b->left);
+  update(b);
+  return b;
+}
+
+// Splits a tree into the first `offset' bytes and the rest. A chunk that the offset falls inside is
+// cut in two, which needs a spare node.
+static void split(struct wcrope* rope, struct node* n, size_t offset, struct node** l, struct node** r) {
+  size_t before;
+  if (n == NULL) {
+    *l = *r = NULL;
+    return;
+  }
+  before = n->left == NULL ? 0 : n->left->sum.chars;
+  if (offset <= before) {
+    split(rope, n->left, offset, l, &n->left);
+    update(n);
+    *r = n;
+  } else if (offset >= before + n->length) {
+    split(rope, n->right, offset - before - n->length, &n->right, r);
+    update(n);
+    *l = n;
+  } else {
+    struct node* m = take(rope);
+    size_t cut = offset - before;
+    m->length = n->length - cut;
+    memcpy(m->text, n->text + cut, m->length);
+    m->priority = n->priority;
+    m->right = n->right;
+    n->length = cut;
+    n->right = NULL;
+    count(n);
+    count(m);
+    update(n);
+    update(m);
+    *l = n;
+    *r = m;
+  }
+}
+
+// Inserts or deletes inside a single chunk when the chunk has room for the insertion and keeps some
+// bytes after the deletion, which is what typing does. Returns whether it did.
+static bool edit_chunk(struct node* n, size_t offset, const char* text, size_t inserted, size_t deleted) {
+  size_t before;
+  bool done;
+  if (n == NULL) return false;
+  before = n->left == NULL ? 0 : n->left->sum.chars;
+  // An insertion between two chunks goes at the end of the first.
+  if (offset < before || (offset == before && before > 0 && deleted == 0)) {
+    done = edit_chunk(n->left, offset, text, inserted, deleted);
+  } else if (offset > before + n->length || (offset == before + n->length && deleted > 0)) {
+    done = edit_chunk(n->right, offset - before - n->length, text, inserted, deleted);
+  } else {
+    offset -= before;
+    if (n->length + inserted > WCROPE_CHUNK || offset + deleted > n->length || deleted == n->length) return false;
+    memmove(n->text + offset + inserted, n->text + offset + deleted, n->length - offset - deleted);
+    if (inserted > 0) memcpy(n->text + offset, text, inserted);
+    n->length += inserted - deleted;
+    count(n);
+    done = true;
+  }
+  if (done) update(n);
+  return done;
+}
+
+static size_t last_length(const struct node* n) {
+  while (n->right != NULL) n = n->right;
+  return n->length;
+}
+
+static size_t first_length(const struct node* n) {
+  while (n->left != NULL) n = n->left;
+  return n->length;
+}
+
+// Detaches the first node of a tree into `first'.
+static struct node* take_first(struct node* n, struct node** first) {
+  if (n->left == NULL) {
+    struct node* rest = n->right;
+    n->right = NULL;
+    *first = n;
+    return rest;
+  }
+  n->left = take_first(n->left, first);
+  update(n);
+  return n;
+}
+
+static void append_last(struct node* n, const char* text, size_t length) {
+  if (n->right != NULL) {
+    append_last(n->right, text, length);
+  } else {
+    memcpy(n->text + n->length, text, length);
+    n->length += length;
+    count(n);
+  }
+  update(n);
+}
+
+struct wcrope* wcrope_new(void) {
+  struct wcrope* rope = malloc(sizeof(struct wcrope));
+  if (rope == NULL) return NULL;
+  rope->root = rope->spare = NULL;
+  rope->seed = 2463534242u;
+  return rope;
+}
+
+void wcrope_free(struct wcrope* rope) {
+  if (rope == NULL) return;
+  free_tree(rope->root);
+  while (rope->spare != NULL) {
+    struct node* n = rope->spare;
+    rope->spare = n->left;
+    free(n);
+  }
+  free(rope);
+}
+
+int wcrope_insert(struct wcrope* rope, size_t offset, const char* text, size_t length) {
+  struct node* l;
+  struct node* r;
+  struct node* middle = NULL;
+  size_t done;
+  if (offset > sum(rope->root).chars) return -1;
+  if (length == 0 || edit_chunk(rope->root, offset, text, length, 0)) return 0;
+  if (reserve(rope, 1 + (length + WCROPE_CHUNK - 1) / WCROPE_CHUNK) != 0) return -1;
+  split(rope, rope->root, offset, &l, &r);
+  for (done = 0; done < length; done += WCROPE_CHUNK) {
+    struct node* n = take(rope);
+    n->length = length - done < WCROPE_CHUNK ? length - done : WCROPE_CHUNK;
+    memcpy(n->text, text + done, n->length);
+    count(n);
+    update(n);
+    middle = merge(middle, n);
+  }
+  rope->root = merge(merge(l, middle), r);
+  return 0;
+}
+
+int wcrope_delete(struct wcrope* rope, size_t offset, size_t length) {
+  struct node* l;
+  struct node* r;
+  struct node* middle;
+  if (offset > sum(rope->root).chars || length > sum(rope->root).chars - offset) return -1;
+  if (length == 0 || edit_chunk(rope->root, offset, NULL, 0, length)) return 0;
+  if (reserve(rope, 2) != 0) return -1;
+  split(rope, rope->root, offset, &l, &middle);
+  split(rope, middle, length, &middle, &r);
+  free_tree(middle);
+  // The chunks on both sides of the deletion are joined when they fit in one, so that deletions do
+  // not leave the text in ever smaller chunks.
+  if (l != NULL && r != NULL && last_length(l) + first_length(r) <= WCROPE_CHUNK) {
+    struct node* first;
+    r = take_first(r, &first);
+    append_last(l, first->text, first->length);
+    free(first);
+  }
+  rope->root = merge(l, r);
+  return 0;
+}
+
+struct wcrope_counts wcrope_counts(const struct wcrope* rope) {
+  struct summary s = sum(rope->root);
+  struct wcrope_counts counts = {s.lines, s.words, s.chars};
+  return counts;
+}
+
+static size_t read_tree(const struct node* n, size_t offset, char* buffer, size_t length) {
+  size_t before, copied = 0;
+  if (n == NULL || length == 0) return 0;
+  before = n->left == NULL ? 0 : n->left->sum.chars;
+  if (offset < before) copied = read_tree(n->left, offset, buffer, length);
+  if (offset + copied >= before && offset + copied < before + n->length && copied < length) {
+    size_t from = offset + copied - before;
+    size_t size = n->length - from < length - copied ? n->length - from : length - copied;
+    memcpy(buffer + copied, n->text + from, size);
+    copied += size;
+  }
+  if (copied < length && offset + copied >= before + n->length) {
+    copied += read_tree(n->right, offset + copied - before - n->length, buffer + copied, length - copied);
+  }
+  return copied;
+}
+
+size_t wcrope_read(const struct wcrope* rope, size_t offset, char* buffer, size_t length) {
+  return read_tree(rope->root, offset, buffer, length);
+}
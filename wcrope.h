@@ -0,0 +1,48 @@
+/*
+ * wcrope -- line, word, and character counts of a text that is being edited
+ *
+ * A wcrope holds a text, such as the buffer of an editor, in chunks of at most WCROPE_CHUNK bytes
+ * kept in a balanced tree, a treap ordered by position. Every node has the counts of its own chunk
+ * and the sum of the counts of its subtree, so the totals are always at the root. An insertion or a
+ * deletion splits the tree at its ends and joins it again, in O(log n) for n chunks, and only counts
+ * the bytes of the chunks it cuts or fills again, so the counts of a large buffer follow each edit
+ * in microseconds. Lines, words, and characters are counted like mywc counts them: a line ends with a
+ * <newline>, a word is a run of bytes other than <tab>, <newline>, <vertical-tab>, <form-feed>,
+ * <carriage-return> and <space>, and a character is a byte.
+ *
+ * Compile wcrope.c with the program that uses it, for example ``gcc -o editor editor.c wcrope.c''.
+ */
+#ifndef WCROPE_H
+#define WCROPE_H
+
+#include <stddef.h>
+
+#define WCROPE_CHUNK 1024
+
+struct wcrope;
+
+struct wcrope_counts {
+  size_t lines;
+  size_t words;
+  size_t chars;
+};
+
+// Returns an empty rope, or NULL when there is no memory for it.
+struct wcrope* wcrope_new(void);
+
+void wcrope_free(struct wcrope* rope);
+
+// Inserts `length' bytes of `text' at byte `offset'. Returns 0, or -1 when `offset' is past the end
+// of the text or there is no memory, in which case the text is unchanged.
+int wcrope_insert(struct wcrope* rope, size_t offset, const char* text, size_t length);
+
+// Deletes `length' bytes from byte `offset'. Returns 0, or -1 when the range is past the end of the
+// text or there is no memory, in which case the text is unchanged.
+int wcrope_delete(struct wcrope* rope, size_t offset, size_t length);
+
+struct wcrope_counts wcrope_counts(const struct wcrope* rope);
+
+// Copies at most `length' bytes of the text from byte `offset' to `buffer', and returns how many.
+size_t wcrope_read(const struct wcrope* rope, size_t offset, char* buffer, size_t length);
+
+#endif
@@ -0,0 +1,87 @@
+// Edits a wcrope and a plain copy of its text at random, and checks the counts and the text of the
+// rope against the copy. Prints what differs, if anything, and exits 1 then.
+#include "wcrope.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EDITS 200000
+#define LIMIT (1 << 20)
+
+static char TEXT[2 * LIMIT];
+static size_t LENGTH = 0;
+
+static void count(size_t* lines, size_t* words) {
+  size_t i;
+  int space = 1;
+  *lines = *words = 0;
+  for (i = 0; i < LENGTH; i++) {
+    unsigned char c = TEXT[i];
+    int next = c == ' ' || (c >= '\t' && c <= '\r');
+    *lines += c == '\n';
+    *words += space && !next;
+    space = next;
+  }
+}
+
+static int check(struct wcrope* rope, int edit) {
+  static char buffer[8192];
+  struct wcrope_counts counts = wcrope_counts(rope);
+  size_t lines, words, offset = rand() % (LENGTH + 1), length = rand() % sizeof(buffer), read;
+  count(&lines, &words);
+  if (counts.lines != lines || counts.words != words || counts.chars != LENGTH) {
+    printf("edit %d: counts %zu %zu %zu instead of %zu %zu %zu\n", edit, counts.lines, counts.words, counts.chars,
+           lines, words, LENGTH);
+    return 1;
+  }
+  read = wcrope_read(rope, offset, buffer, length);
+  if (read != (length < LENGTH - offset ? length : LENGTH - offset) || memcmp(buffer, TEXT + offset, read) != 0) {
+    printf("edit %d: read of %zu bytes at %zu differs\n", edit, length, offset);
+    return 1;
+  }
+  return 0;
+}
+
+int main(void) {
+  static char insert[16384];
+  const char bytes[] = "ab \n\tx";
+  struct wcrope* rope = wcrope_new();
+  int edit;
+  if (rope == NULL) return 1;
+  srand(1);
+  for (edit = 0; edit < EDITS; edit++) {
+    // Mostly typing, with a large paste or cut now and then.
+    size_t offset = rand() % (LENGTH + 1), length = rand() % 10 == 0 ? rand() % sizeof(insert) : rand() % 5, i;
+    if (rand() % 3 < 2 || LENGTH == 0) {
+      for (i = 0; i < length; i++) insert[i] = bytes[rand() % 6];
+      if (wcrope_insert(rope, offset, insert, length) != 0) {
+        printf("edit %d: insertion failed\n", edit);
+        return 1;
+      }
+      memmove(TEXT + offset + length, TEXT + offset, LENGTH - offset);
+      memcpy(TEXT + offset, insert, length);
+      LENGTH += length;
+    } else {
+      if (length > LENGTH - offset) length = LENGTH - offset;
+      if (wcrope_delete(rope, offset, length) != 0) {
+        printf("edit %d: deletion failed\n", edit);
+        return 1;
+      }
+      memmove(TEXT + offset, TEXT + offset + length, LENGTH - offset - length);
+      LENGTH -= length;
+    }
+    if (LENGTH > LIMIT) {
+      wcrope_delete(rope, 0, LENGTH / 2);
+      memmove(TEXT, TEXT + LENGTH / 2, LENGTH - LENGTH / 2);
+      LENGTH -= LENGTH / 2;
+    }
+    if (edit % 97 == 0 && check(rope, edit) != 0) return 1;
+  }
+  if (check(rope, edit) != 0) return 1;
+  if (wcrope_insert(rope, LENGTH + 1, "a", 1) != -1 || wcrope_delete(rope, LENGTH, 1) != -1) {
+    printf("an edit past the end of the text did not fail\n");
+    return 1;
+  }
+  wcrope_free(rope);
+  return 0;
+}
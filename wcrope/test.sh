@@ -0,0 +1,4 @@
+# Run from this directory. Builds test.c with the library and prints the differences, if any.
+dir=$(mktemp -d)
+gcc -Wall -O2 -I.. -o "$dir/test" test.c ../wcrope.c && "$dir/test"
+rm -rf "$dir"